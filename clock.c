@@ -17,19 +17,24 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <errno.h>
+#include <limits.h>
+#include <math.h>
 #include <time.h>
 #include <linux/net_tstamp.h>
-#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/queue.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #include "address.h"
 #include "bmc.h"
 #include "clock.h"
 #include "clockadj.h"
 #include "clockcheck.h"
+#include "contain.h"
 #include "foreign.h"
 #include "filter.h"
 #include "missing.h"
@@ -47,6 +52,9 @@
 #include "util.h"
 
 #define N_CLOCK_PFD (N_POLLFD + 1) /* one extra per port, for the fault timer */
+#define N_CLOCK_EVENTS 64 /* ready descriptors handled per wake up */
+#define HOLDOVER_BINS 64 /* frequency history used for the prediction */
+#define CHECKPOINT_PERIOD 10 /* seconds between writes of the checkpoint */
 
 struct interface {
 	STAILQ_ENTRY(interface) list;
@@ -68,6 +76,8 @@ struct clock_stats {
 	struct stats *freq;
 	struct stats *delay;
 	unsigned int max_count;
+	/* histograms of the last summary, see CLOCK_STATS_NP */
+	struct clock_stats_np last;
 };
 
 struct clock_subscriber {
@@ -88,6 +98,64 @@ struct time_zone {
 	struct static_ptp_text display_name;
 };
 
+/* Identifies a descriptor registered with epoll. */
+struct clock_pfd {
+	struct port *port;
+	int index; /* into the fdarray, or N_POLLFD for the fault timer */
+};
+
+struct clock_port_pfd {
+	LIST_ENTRY(clock_port_pfd) list;
+	struct port *port;
+	struct clock_pfd pfd[N_CLOCK_PFD];
+};
+
+/*
+ * Frequency history of the locked servo, averaged over bins of one
+ * holdover interval, and the state of the prediction made from it.
+ */
+struct holdover {
+	int interval; /* seconds, zero disables holdover */
+	int fd;
+	struct clock_pfd pfd;
+	UInteger8 clock_class;
+	struct ClockQuality quality; /* restored when leaving holdover */
+	struct ClockQuality held; /* last quality set by the holdover */
+	double bin_start;
+	double bin_time;
+	double bin_adj;
+	int bin_cnt;
+	double time[HOLDOVER_BINS];
+	double adj[HOLDOVER_BINS];
+	int head;
+	int len;
+	double last_offset;
+	double last_sync;
+	double start;
+	double max_adj; /* ppb, range of the clock */
+	double last_adj; /* ppb, last prediction */
+	int active;
+};
+
+struct checkpoint_port {
+	UInteger16 number;
+	tmv_t peer_delay;
+};
+
+/* State saved for a warm restart, see clock_checkpoint_save(). */
+struct checkpoint {
+	const char *path;
+	time_t locked_time; /* zero until the servo has locked */
+	time_t saved;
+	double freq;
+	struct PortIdentity parent;
+	tmv_t path_delay;
+	int warm; /* loaded, path delay not used yet */
+	int warm_age; /* seconds until the checkpoint is too old */
+	struct checkpoint_port *ports;
+	int n_ports;
+};
+
 struct clock {
 	enum clock_type type;
 	struct config *config;
@@ -106,8 +174,8 @@ struct clock {
 	LIST_HEAD(ports_head, port) ports;
 	struct port *uds_rw_port;
 	struct port *uds_ro_port;
-	struct pollfd *pollfd;
-	int pollfd_valid;
+	int epfd;
+	LIST_HEAD(clock_pfd_head, clock_port_pfd) pfds;
 	int nports; /* does not include the two UDS ports */
 	int last_port_number;
 	int sde;
@@ -132,6 +200,7 @@ struct clock {
 	tmv_t ingress_ts;
 	tmv_t initial_delay;
 	struct tsproc *tsproc;
+	int tsproc_select; /* offsets per servo sample */
 	struct freq_estimator fest;
 	struct time_status_np status;
 	double master_local_rr; /* maintained when free_running */
@@ -147,12 +216,15 @@ struct clock {
 	int step_window_counter;
 	int step_window;
 	struct time_zone tz[MAX_TIME_ZONES];
+	struct holdover holdover;
+	struct checkpoint checkpoint;
 };
 
 struct clock the_clock;
 
 static void handle_state_decision_event(struct clock *c);
-static int clock_resize_pollfd(struct clock *c, int new_nports);
+static void clock_checkpoint_save(struct clock *c);
+static void clock_remove_pfd(struct clock *c, struct port *p);
 static void clock_remove_port(struct clock *c, struct port *p);
 static void clock_stats_display(struct clock_stats *s);
 
@@ -343,6 +415,7 @@ void clock_destroy(struct clock *c)
 {
 	struct port *p, *tmp;
 
+	clock_checkpoint_save(c);
 	interface_destroy(c->uds_rw_if);
 	interface_destroy(c->uds_ro_if);
 	clock_flush_subscriptions(c);
@@ -350,9 +423,16 @@ void clock_destroy(struct clock *c)
 		clock_remove_port(c, p);
 	}
 	monitor_destroy(c->slave_event_monitor);
+	clock_remove_pfd(c, c->uds_rw_port);
+	clock_remove_pfd(c, c->uds_ro_port);
 	port_close(c->uds_rw_port);
 	port_close(c->uds_ro_port);
-	free(c->pollfd);
+	if (c->holdover.interval && c->holdover.fd >= 0) {
+		close(c->holdover.fd);
+	}
+	if (c->epfd >= 0) {
+		close(c->epfd);
+	}
 	if (c->clkid != CLOCK_REALTIME) {
 		phc_close(c->clkid);
 	}
@@ -419,7 +499,10 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 	struct alternate_time_offset_properties *atop;
 	struct alternate_time_offset_name *aton;
 	struct grandmaster_settings_np *gsn;
+	struct message_pool_stats_np *mpsn;
 	struct management_tlv_datum *mtd;
+	struct clock_stats_np *csn;
+	struct MessagePoolStats pool_stats;
 	struct subscribe_events_np *sen;
 	struct management_tlv *tlv;
 	struct time_status_np *tsn;
@@ -561,6 +644,22 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 		gsn->time_source = c->time_source;
 		datalen = sizeof(*gsn);
 		break;
+	case MID_MESSAGE_POOL_STATS_NP:
+		mpsn = (struct message_pool_stats_np *) tlv->data;
+		msg_pool_stats(&pool_stats);
+		memcpy(&mpsn->stats, &pool_stats, sizeof(mpsn->stats));
+		datalen = sizeof(*mpsn);
+		break;
+	case MID_CLOCK_STATS_NP:
+		if (c->stats.max_count <= 1) {
+			/* The samples are printed, there are no histograms. */
+			tlv_extra_recycle(extra);
+			return 0;
+		}
+		csn = (struct clock_stats_np *) tlv->data;
+		memcpy(csn, &c->stats.last, sizeof(*csn));
+		datalen = sizeof(*csn);
+		break;
 	case MID_SUBSCRIBE_EVENTS_NP:
 		if (p != c->uds_rw_port) {
 			/* Only the UDS-RW port allowed. */
@@ -722,26 +821,52 @@ static void clock_stats_update(struct clock_stats *s,
 	clock_stats_display(s);
 }
 
+static void clock_stats_histogram(struct stats *s,
+				  struct stats_result *result,
+				  struct StatsHistogram *h)
+{
+	uint32_t bins[STATS_HISTOGRAM_BINS];
+
+	memset(h, 0, sizeof(*h));
+	h->count = stats_get_histogram(s, bins, STATS_HISTOGRAM_BINS);
+	memcpy(h->bins, bins, sizeof(h->bins));
+	if (!h->count)
+		return;
+	h->p50 = llround(result->p50);
+	h->p99 = llround(result->p99);
+	h->p999 = llround(result->p999);
+	h->max = llround(result->max_abs);
+}
+
 static void clock_stats_display(struct clock_stats *s)
 {
 	struct stats_result offset_stats, freq_stats, delay_stats;
 
 	stats_get_result(s->offset, &offset_stats);
 	stats_get_result(s->freq, &freq_stats);
+	clock_stats_histogram(s->offset, &offset_stats, &s->last.offset);
 
 	/* Path delay stats are updated separately, they may be empty. */
 	if (!stats_get_result(s->delay, &delay_stats)) {
 		pr_info("rms %4.0f max %4.0f "
 			"freq %+6.0f +/- %3.0f "
-			"delay %5.0f +/- %3.0f",
+			"delay %5.0f +/- %3.0f "
+			"p50 %4.0f p99 %4.0f p99.9 %4.0f "
+			"delay p50 %5.0f p99 %5.0f p99.9 %5.0f",
 			offset_stats.rms, offset_stats.max_abs,
 			freq_stats.mean, freq_stats.stddev,
-			delay_stats.mean, delay_stats.stddev);
+			delay_stats.mean, delay_stats.stddev,
+			offset_stats.p50, offset_stats.p99, offset_stats.p999,
+			delay_stats.p50, delay_stats.p99, delay_stats.p999);
+		clock_stats_histogram(s->delay, &delay_stats, &s->last.delay);
 	} else {
 		pr_info("rms %4.0f max %4.0f "
-			"freq %+6.0f +/- %3.0f",
+			"freq %+6.0f +/- %3.0f "
+			"p50 %4.0f p99 %4.0f p99.9 %4.0f",
 			offset_stats.rms, offset_stats.max_abs,
-			freq_stats.mean, freq_stats.stddev);
+			freq_stats.mean, freq_stats.stddev,
+			offset_stats.p50, offset_stats.p99, offset_stats.p999);
+		memset(&s->last.delay, 0, sizeof(s->last.delay));
 	}
 
 	stats_reset(s->offset);
@@ -876,6 +1001,389 @@ static void clock_update_slave(struct clock *c)
 		clock_notify_event(c, NOTIFY_PARENT_DATA_SET);
 }
 
+static double clock_holdover_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int clock_holdover_init(struct clock *c)
+{
+	struct holdover *h = &c->holdover;
+	struct epoll_event event;
+	struct itimerspec tmo;
+
+	if (c->free_running) {
+		pr_warning("holdover is not supported with free_running");
+		h->interval = 0;
+		return 0;
+	}
+	h->fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (h->fd < 0) {
+		pr_err("timerfd_create failed: %m");
+		return -1;
+	}
+	tmo.it_value.tv_sec = h->interval;
+	tmo.it_value.tv_nsec = 0;
+	tmo.it_interval = tmo.it_value;
+	if (timerfd_settime(h->fd, 0, &tmo, NULL)) {
+		pr_err("timerfd_settime failed: %m");
+		return -1;
+	}
+	h->pfd.port = NULL;
+	h->pfd.index = N_POLLFD;
+	event.events = EPOLLIN;
+	event.data.ptr = &h->pfd;
+	if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, h->fd, &event)) {
+		pr_err("failed to add the holdover timer to epoll: %m");
+		return -1;
+	}
+	return 0;
+}
+
+/* Accumulate the frequency applied by the locked servo. */
+static void clock_holdover_sample(struct clock *c, double adj)
+{
+	struct holdover *h = &c->holdover;
+	double now;
+
+	if (!h->interval) {
+		return;
+	}
+	now = clock_holdover_now();
+	h->last_sync = now;
+	h->last_offset = tmv_dbl(c->master_offset);
+	if (!h->bin_cnt) {
+		h->bin_start = now;
+		h->bin_time = 0.0;
+		h->bin_adj = 0.0;
+	}
+	h->bin_time += now;
+	h->bin_adj += adj;
+	h->bin_cnt++;
+	if (now - h->bin_start < h->interval) {
+		return;
+	}
+	h->time[h->head] = h->bin_time / h->bin_cnt;
+	h->adj[h->head] = h->bin_adj / h->bin_cnt;
+	h->head = (h->head + 1) % HOLDOVER_BINS;
+	if (h->len < HOLDOVER_BINS) {
+		h->len++;
+	}
+	h->bin_cnt = 0;
+}
+
+/*
+ * Fit the frequency and its drift to the history and predict the
+ * frequency at the given time. The bound on the accumulated time error
+ * since the start of the holdover is returned in 'error'.
+ */
+static double clock_holdover_predict(struct holdover *h, double now,
+				     double *error)
+{
+	double tm = 0.0, am = 0.0, sxx = 0.0, sxy = 0.0, var = 0.0;
+	double adj, drift, dt, r;
+	int i;
+
+	for (i = 0; i < h->len; i++) {
+		tm += h->time[i];
+		am += h->adj[i];
+	}
+	tm /= h->len;
+	am /= h->len;
+	for (i = 0; i < h->len; i++) {
+		sxx += (h->time[i] - tm) * (h->time[i] - tm);
+		sxy += (h->time[i] - tm) * (h->adj[i] - am);
+	}
+	drift = sxx > 0.0 ? sxy / sxx : 0.0;
+	if (h->len > 2) {
+		for (i = 0; i < h->len; i++) {
+			r = h->adj[i] - am - drift * (h->time[i] - tm);
+			var += r * r;
+		}
+		var /= h->len - 2;
+	}
+
+	/* Frequency error integrates to ppb * s = ns of time error. */
+	dt = now - h->start;
+	*error = fabs(h->last_offset) + sqrt(var) * dt;
+	if (sxx > 0.0) {
+		*error += 0.5 * sqrt(var / sxx) * dt * dt;
+	}
+
+	/* The drift can't be extrapolated beyond the range of the clock. */
+	adj = am + drift * (now - tm);
+	if (adj > h->max_adj) {
+		adj = h->max_adj;
+	} else if (adj < -h->max_adj) {
+		adj = -h->max_adj;
+	}
+	return adj;
+}
+
+static UInteger8 clock_holdover_accuracy(double error)
+{
+	static const double limits[] = {
+		25e0, 100e0, 250e0, 1e3, 2.5e3, 10e3, 25e3, 100e3, 250e3,
+		1e6, 2.5e6, 10e6, 25e6, 100e6, 250e6, 1e9, 10e9,
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(limits); i++) {
+		if (error <= limits[i]) {
+			return 0x20 + i;
+		}
+	}
+	return 0x31;
+}
+
+static int clock_quality_eq(struct ClockQuality *a, struct ClockQuality *b)
+{
+	return a->clockClass == b->clockClass &&
+		a->clockAccuracy == b->clockAccuracy &&
+		a->offsetScaledLogVariance == b->offsetScaledLogVariance;
+}
+
+static void clock_holdover_quality(struct clock *c, struct ClockQuality q)
+{
+	struct holdover *h = &c->holdover;
+
+	h->held = q;
+	if (clock_quality_eq(&q, &c->dds.clockQuality)) {
+		return;
+	}
+	c->dds.clockQuality = q;
+	/* Let the BMCA and the grand master data set see the new quality. */
+	c->sde = 1;
+}
+
+/*
+ * Called before the first sample after the holdover. The servo continues
+ * from the last predicted frequency, and the quality saved on entry is
+ * restored unless it was changed by management in the meantime.
+ */
+static void clock_holdover_exit(struct clock *c)
+{
+	struct holdover *h = &c->holdover;
+
+	if (!h->active) {
+		return;
+	}
+	pr_notice("leaving holdover after %.0f seconds",
+		  clock_holdover_now() - h->start);
+	h->active = 0;
+	servo_seed(c->servo, h->last_adj);
+	if (clock_quality_eq(&h->held, &c->dds.clockQuality)) {
+		clock_holdover_quality(c, h->quality);
+	}
+}
+
+static void clock_holdover_event(struct clock *c)
+{
+	struct holdover *h = &c->holdover;
+	struct ClockQuality q;
+	double adj, error, now;
+	uint64_t expirations;
+
+	if (read(h->fd, &expirations, sizeof(expirations)) < 0) {
+		pr_err("failed to read the holdover timer: %m");
+		return;
+	}
+	now = clock_holdover_now();
+
+	if (!h->active) {
+		if (h->len < 2 || now - h->last_sync < 2 * h->interval) {
+			return;
+		}
+		/* The partial bin belongs to the old servo state. */
+		h->bin_cnt = 0;
+		h->start = h->last_sync;
+		h->quality = c->dds.clockQuality;
+		h->held = h->quality;
+		h->last_adj = h->adj[(h->head + HOLDOVER_BINS - 1) % HOLDOVER_BINS];
+		h->active = 1;
+		pr_notice("entering holdover with %d seconds of history",
+			  h->len * h->interval);
+	} else if (!clock_quality_eq(&h->held, &c->dds.clockQuality)) {
+		/* Set by management, keep it when leaving holdover. */
+		h->quality = c->dds.clockQuality;
+	}
+
+	adj = clock_holdover_predict(h, now, &error);
+	if (clockadj_set_freq(c->clkid, -adj)) {
+		return;
+	}
+	h->last_adj = adj;
+	if (c->sanity_check) {
+		clockcheck_set_freq(c->sanity_check, -adj);
+	}
+
+	q = h->quality;
+	if (h->clock_class) {
+		q.clockClass = h->clock_class;
+	}
+	q.clockAccuracy = clock_holdover_accuracy(error);
+	clock_holdover_quality(c, q);
+
+	pr_info("holdover %.0f s freq %+7.0f error %.0f",
+		now - h->start, adj, error);
+}
+
+/*
+ * Write the servo frequency, the parent and the path and peer delays of
+ * the last lock, so that a restarted ptp4l can continue from there.
+ */
+static void clock_checkpoint_save(struct clock *c)
+{
+	struct checkpoint *cp = &c->checkpoint;
+	char tmp[PATH_MAX];
+	struct port *p;
+	tmv_t delay;
+	FILE *fp;
+
+	if (!cp->path || !cp->path[0] || !cp->locked_time) {
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", cp->path);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		pr_err("failed to open %s: %m", tmp);
+		return;
+	}
+	fprintf(fp, "time %lld\n", (long long) cp->locked_time);
+	fprintf(fp, "freq %.3f\n", cp->freq);
+	fprintf(fp, "parent %s\n", pid2str(&cp->parent));
+	fprintf(fp, "path_delay %" PRId64 "\n",
+		tmv_to_nanoseconds(cp->path_delay));
+	LIST_FOREACH(p, &c->ports, list) {
+		delay = port_peer_mean_delay(p);
+		if (port_delay_mechanism(p) != DM_P2P || tmv_is_zero(delay)) {
+			continue;
+		}
+		fprintf(fp, "port %d %" PRId64 "\n", port_number(p),
+			tmv_to_nanoseconds(delay));
+	}
+	if (fclose(fp) || rename(tmp, cp->path)) {
+		pr_err("failed to write %s: %m", cp->path);
+		unlink(tmp);
+		return;
+	}
+	cp->saved = cp->locked_time;
+}
+
+static void clock_checkpoint_locked(struct clock *c)
+{
+	struct checkpoint *cp = &c->checkpoint;
+	struct timespec now;
+
+	if (!cp->path || !cp->path[0]) {
+		return;
+	}
+	clock_gettime(CLOCK_REALTIME, &now);
+	cp->locked_time = now.tv_sec;
+	/* Without the phase correction, which is not valid after a restart. */
+	cp->freq = servo_frequency(c->servo);
+	cp->parent = c->dad.pds.parentPortIdentity;
+	cp->path_delay = c->path_delay;
+	if (now.tv_sec - cp->saved >= CHECKPOINT_PERIOD) {
+		clock_checkpoint_save(c);
+	}
+}
+
+static int clock_checkpoint_load(struct clock *c, int max_adj)
+{
+	struct checkpoint *cp = &c->checkpoint;
+	struct checkpoint_port *ports;
+	char line[128], pid[64];
+	long long saved = 0;
+	struct timespec now;
+	int64_t delay;
+	int max_age, n;
+	FILE *fp;
+
+	if (!cp->path || !cp->path[0]) {
+		return -1;
+	}
+	fp = fopen(cp->path, "r");
+	if (!fp) {
+		if (errno != ENOENT) {
+			pr_err("failed to open %s: %m", cp->path);
+		}
+		return -1;
+	}
+	pid[0] = '\0';
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "time %lld", &saved) == 1 ||
+		    sscanf(line, "freq %lf", &cp->freq) == 1 ||
+		    sscanf(line, "parent %63s", pid) == 1) {
+			continue;
+		}
+		if (sscanf(line, "path_delay %" SCNd64, &delay) == 1) {
+			cp->path_delay = nanoseconds_to_tmv(delay);
+		} else if (sscanf(line, "port %d %" SCNd64, &n, &delay) == 2) {
+			ports = realloc(cp->ports,
+					(cp->n_ports + 1) * sizeof(*ports));
+			if (!ports) {
+				break;
+			}
+			cp->ports = ports;
+			cp->ports[cp->n_ports].number = n;
+			cp->ports[cp->n_ports].peer_delay =
+				nanoseconds_to_tmv(delay);
+			cp->n_ports++;
+		}
+	}
+	fclose(fp);
+
+	if (!saved || str2pid(pid, &cp->parent) || fabs(cp->freq) > max_adj) {
+		pr_err("invalid checkpoint in %s", cp->path);
+		goto invalid;
+	}
+	max_age = config_get_int(c->config, NULL, "checkpoint_max_age");
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (saved > now.tv_sec || now.tv_sec - saved > max_age) {
+		pr_info("checkpoint in %s is too old", cp->path);
+		goto invalid;
+	}
+	pr_notice("warm start from %s saved %lld seconds ago",
+		  cp->path, (long long) (now.tv_sec - saved));
+	cp->warm = 1;
+	cp->warm_age = max_age - (now.tv_sec - saved);
+	return 0;
+invalid:
+	free(cp->ports);
+	cp->ports = NULL;
+	cp->n_ports = 0;
+	return -1;
+}
+
+/* Let the ports and the delay estimate start from the checkpoint. */
+static void clock_checkpoint_ports(struct clock *c)
+{
+	struct checkpoint *cp = &c->checkpoint;
+	struct port *p;
+	tmv_t delay;
+	int i;
+
+	if (!cp->warm) {
+		return;
+	}
+	LIST_FOREACH(p, &c->ports, list) {
+		delay = tmv_zero();
+		for (i = 0; i < cp->n_ports; i++) {
+			if (cp->ports[i].number == port_number(p)) {
+				delay = cp->ports[i].peer_delay;
+			}
+		}
+		port_warm_start(p, &cp->parent, delay, cp->warm_age);
+	}
+	free(cp->ports);
+	cp->ports = NULL;
+	cp->n_ports = 0;
+}
+
 static int clock_utc_correct(struct clock *c, tmv_t ingress)
 {
 	struct timespec offset;
@@ -1009,13 +1517,9 @@ static int clock_add_port(struct clock *c, const char *phc_device,
 {
 	struct port *p, *piter, *lastp = NULL;
 
-	if (clock_resize_pollfd(c, c->nports + 2)) {
-		return -1;
-	}
 	p = port_open(phc_device, phc_index, timestamping,
 		      ++c->last_port_number, iface, c);
 	if (!p) {
-		/* No need to shrink pollfd */
 		return -1;
 	}
 	LIST_FOREACH(piter, &c->ports, list) {
@@ -1027,21 +1531,16 @@ static int clock_add_port(struct clock *c, const char *phc_device,
 		LIST_INSERT_HEAD(&c->ports, p, list);
 	}
 	c->nports++;
-	clock_fda_changed(c);
+	clock_fda_changed(c, p);
 
 	return 0;
 }
 
 static void clock_remove_port(struct clock *c, struct port *p)
 {
-	/* Do not call clock_resize_pollfd, it's pointless to shrink
-	 * the allocated memory at this point, clock_destroy will free
-	 * it all anyway. This function is usable from other parts of
-	 * the code, but even then we don't mind if pollfd is larger
-	 * than necessary. */
 	LIST_REMOVE(p, list);
 	c->nports--;
-	clock_fda_changed(c);
+	clock_remove_pfd(c, p);
 	port_close(p);
 }
 
@@ -1288,6 +1787,11 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	c->utc_offset = config_get_int(config, NULL, "utc_offset");
 	c->time_source = config_get_int(config, NULL, "timeSource");
 	c->step_window = config_get_int(config, NULL, "step_window");
+	c->holdover.interval = config_get_int(config, NULL, "holdover_interval");
+	c->holdover.clock_class =
+		config_get_int(config, NULL, "holdover_clock_class");
+	c->holdover.fd = -1;
+	c->checkpoint.path = config_get_string(config, NULL, "checkpoint_file");
 
 	if (c->free_running) {
 		c->clkid = CLOCK_INVALID;
@@ -1328,6 +1832,10 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 
 	if (c->clkid != CLOCK_INVALID) {
 		fadj = clockadj_get_freq(c->clkid);
+		if (!clock_checkpoint_load(c, max_adj)) {
+			fadj = -c->checkpoint.freq;
+			clockadj_set_freq(c->clkid, fadj);
+		}
 		/* Disable write phase mode if not implemented by driver */
 		if (c->write_phase_mode && !phc_has_writephase(c->clkid)) {
 			pr_err("clock does not support write phase mode");
@@ -1339,6 +1847,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		pr_err("Failed to create clock servo");
 		return NULL;
 	}
+	c->holdover.max_adj = max_adj;
 	c->servo_state = SERVO_UNLOCKED;
 	c->servo_type = servo;
 	if (config_get_int(config, NULL, "dataset_comparison") == DS_CMP_G8275) {
@@ -1348,11 +1857,21 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	}
 	c->tsproc = tsproc_create(config_get_int(config, NULL, "tsproc_mode"),
 				  config_get_int(config, NULL, "delay_filter"),
-				  config_get_int(config, NULL, "delay_filter_length"));
+				  config_get_int(config, NULL, "delay_filter_length"),
+				  config_get_int(config, NULL, "delay_filter_percentile"));
 	if (!c->tsproc) {
 		pr_err("Failed to create time stamp processor");
 		return NULL;
 	}
+	c->tsproc_select = config_get_int(config, NULL, "tsproc_select_length");
+	if (tsproc_set_selection(c->tsproc, c->tsproc_select,
+				 config_get_int(config, NULL, "tsproc_select_count"))) {
+		pr_err("Failed to set up packet selection");
+		return NULL;
+	}
+	if (c->tsproc_select < 1) {
+		c->tsproc_select = 1;
+	}
 	c->initial_delay = dbl_tmv(config_get_int(config, NULL, "initial_delay"));
 	if (!tmv_is_zero(c->initial_delay)) {
 		tsproc_set_delay(c->tsproc, c->initial_delay);
@@ -1394,8 +1913,13 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	LIST_INIT(&c->ports);
 	c->last_port_number = 0;
 
-	if (clock_resize_pollfd(c, 0)) {
-		pr_err("failed to allocate pollfd");
+	LIST_INIT(&c->pfds);
+	c->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (c->epfd < 0) {
+		pr_err("failed to create epoll instance: %m");
+		return NULL;
+	}
+	if (c->holdover.interval && clock_holdover_init(c)) {
 		return NULL;
 	}
 
@@ -1413,7 +1937,8 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		pr_err("failed to open the UDS-RO port");
 		return NULL;
 	}
-	clock_fda_changed(c);
+	clock_fda_changed(c, c->uds_rw_port);
+	clock_fda_changed(c, c->uds_ro_port);
 
 	c->slave_event_monitor = monitor_create(config, c->uds_rw_port);
 	if (!c->slave_event_monitor) {
@@ -1436,6 +1961,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	}
 	port_dispatch(c->uds_rw_port, EV_INITIALIZE, 0);
 	port_dispatch(c->uds_ro_port, EV_INITIALIZE, 0);
+	clock_checkpoint_ports(c);
 
 	return c;
 }
@@ -1502,56 +2028,76 @@ struct ClockIdentity clock_identity(struct clock *c)
 	return c->dds.clockIdentity;
 }
 
-static int clock_resize_pollfd(struct clock *c, int new_nports)
+static struct clock_port_pfd *clock_port_pfd(struct clock *c, struct port *p)
 {
-	struct pollfd *new_pollfd;
+	struct clock_port_pfd *cp;
+	int i;
 
-	/* Need to allocate two whole extra blocks of fds for UDS ports. */
-	new_pollfd = realloc(c->pollfd,
-			     (new_nports + 2) * N_CLOCK_PFD *
-			     sizeof(struct pollfd));
-	if (!new_pollfd) {
-		return -1;
+	LIST_FOREACH(cp, &c->pfds, list) {
+		if (cp->port == p) {
+			return cp;
+		}
 	}
-	c->pollfd = new_pollfd;
-	return 0;
+	cp = calloc(1, sizeof(*cp));
+	if (!cp) {
+		return NULL;
+	}
+	cp->port = p;
+	for (i = 0; i < N_CLOCK_PFD; i++) {
+		cp->pfd[i].port = p;
+		cp->pfd[i].index = i;
+	}
+	LIST_INSERT_HEAD(&c->pfds, cp, list);
+	return cp;
 }
 
-static void clock_fill_pollfd(struct pollfd *dest, struct port *p)
+static void clock_remove_pfd(struct clock *c, struct port *p)
 {
-	struct fdarray *fda;
-	int i;
+	struct clock_port_pfd *cp;
 
-	fda = port_fda(p);
-	for (i = 0; i < N_POLLFD; i++) {
-		dest[i].fd = fda->fd[i];
-		dest[i].events = POLLIN|POLLPRI;
+	/* Closing the descriptors removes them from the epoll set. */
+	LIST_FOREACH(cp, &c->pfds, list) {
+		if (cp->port == p) {
+			LIST_REMOVE(cp, list);
+			free(cp);
+			return;
+		}
 	}
-	dest[i].fd = port_fault_fd(p);
-	dest[i].events = POLLIN|POLLPRI;
 }
 
-static void clock_check_pollfd(struct clock *c)
+void clock_fda_changed(struct clock *c, struct port *p)
 {
-	struct port *p;
-	struct pollfd *dest = c->pollfd;
+	struct clock_port_pfd *cp;
+	struct epoll_event ev;
+	struct fdarray *fda;
+	int fd, i;
 
-	if (c->pollfd_valid) {
+	cp = clock_port_pfd(c, p);
+	if (!cp) {
+		pr_err("%s: failed to allocate epoll data", port_log_name(p));
 		return;
 	}
-	LIST_FOREACH(p, &c->ports, list) {
-		clock_fill_pollfd(dest, p);
-		dest += N_CLOCK_PFD;
-	}
-	clock_fill_pollfd(dest, c->uds_rw_port);
-	dest += N_CLOCK_PFD;
-	clock_fill_pollfd(dest, c->uds_ro_port);
-	c->pollfd_valid = 1;
-}
+	fda = port_fda(p);
 
-void clock_fda_changed(struct clock *c)
-{
-	c->pollfd_valid = 0;
+	/*
+	 * Closed descriptors have already left the epoll set, even when
+	 * a new one was opened with the same number, so it is enough to
+	 * add whatever is open now.
+	 */
+	for (i = 0; i < N_CLOCK_PFD; i++) {
+		fd = i < N_POLLFD ? fda->fd[i] : port_fault_fd(p);
+		if (fd < 0) {
+			continue;
+		}
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN|EPOLLPRI;
+		ev.data.ptr = &cp->pfd[i];
+		if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, fd, &ev) &&
+		    errno != EEXIST) {
+			pr_err("%s: failed to add fda[%d] to epoll set: %m",
+			       port_log_name(p), i);
+		}
+	}
 }
 
 static int clock_do_forward_mgmt(struct clock *c,
@@ -1707,6 +2253,8 @@ int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 	case MID_GRANDMASTER_SETTINGS_NP:
 	case MID_SUBSCRIBE_EVENTS_NP:
 	case MID_SYNCHRONIZATION_UNCERTAIN_NP:
+	case MID_MESSAGE_POOL_STATS_NP:
+	case MID_CLOCK_STATS_NP:
 		clock_management_send_error(p, msg, MID_NOT_SUPPORTED);
 		break;
 	default:
@@ -1780,16 +2328,32 @@ void clock_set_sde(struct clock *c, int sde)
 	c->sde = sde;
 }
 
+static void clock_uds_event(struct clock *c, struct clock_pfd *pfd,
+			    uint32_t revents)
+{
+	enum fsm_event event;
+
+	if (pfd->index == N_POLLFD || !(revents & (EPOLLIN|EPOLLPRI))) {
+		return;
+	}
+	event = port_event(pfd->port, pfd->index);
+	/* sde is not expected on the UDS-RO port */
+	if (pfd->port == c->uds_rw_port && EV_STATE_DECISION_EVENT == event) {
+		c->sde = 1;
+	}
+}
+
 int clock_poll(struct clock *c)
 {
-	int cnt, i;
+	struct epoll_event ev[N_CLOCK_EVENTS];
 	enum port_state prior_state;
+	struct clock_pfd *pfd, *other;
 	enum fsm_event event;
-	struct pollfd *cur;
+	int cnt, i, j;
+	uint32_t revents;
 	struct port *p;
 
-	clock_check_pollfd(c);
-	cnt = poll(c->pollfd, (c->nports + 2) * N_CLOCK_PFD, -1);
+	cnt = epoll_wait(c->epfd, ev, N_CLOCK_EVENTS, -1);
 	if (cnt < 0) {
 		if (EINTR == errno) {
 			return 0;
@@ -1801,65 +2365,76 @@ int clock_poll(struct clock *c)
 		return 0;
 	}
 
-	cur = c->pollfd;
+	for (i = 0; i < cnt; i++) {
+		pfd = ev[i].data.ptr;
+		if (!pfd) {
+			continue;
+		}
+		if (pfd == &c->holdover.pfd) {
+			clock_holdover_event(c);
+			continue;
+		}
+		p = pfd->port;
+		revents = ev[i].events;
 
-	LIST_FOREACH(p, &c->ports, list) {
-		/* Let the ports handle their events. */
-		for (i = 0; i < N_POLLFD; i++) {
-			if (cur[i].revents & (POLLIN|POLLPRI|POLLERR)) {
-				prior_state = port_state(p);
-				if (cur[i].revents & POLLERR) {
-					int error = sk_get_error(cur[i].fd);
-					pr_err("%s: error on fda[%d]: %s",
-					       port_log_name(p), i,
-					       strerror(error));
-					event = EV_FAULT_DETECTED;
-				} else {
-					event = port_event(p, i);
-				}
-				if (EV_STATE_DECISION_EVENT == event) {
-					c->sde = 1;
-				}
-				if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
-					c->sde = 1;
-				}
-				port_dispatch(p, event, 0);
-				/* Clear any fault after a little while. */
-				if ((PS_FAULTY == port_state(p)) && (prior_state != PS_FAULTY)) {
-					clock_fault_timeout(p, 1);
-					break;
-				}
-			}
+		if (p == c->uds_rw_port || p == c->uds_ro_port) {
+			clock_uds_event(c, pfd, revents);
+			continue;
 		}
 
 		/*
 		 * When the fault timer expires we clear the fault,
 		 * but only if the link is up.
 		 */
-		if (cur[N_POLLFD].revents & (POLLIN|POLLPRI)) {
-			clock_fault_timeout(p, 0);
-			if (port_link_status_get(p)) {
-				port_dispatch(p, EV_FAULT_CLEARED, 0);
+		if (pfd->index == N_POLLFD) {
+			if (revents & (EPOLLIN|EPOLLPRI)) {
+				clock_fault_timeout(p, 0);
+				if (port_link_status_get(p)) {
+					port_dispatch(p, EV_FAULT_CLEARED, 0);
+				}
 			}
+			continue;
 		}
 
-		cur += N_CLOCK_PFD;
-	}
-
-	/* Check the UDS ports. */
-	for (i = 0; i < N_POLLFD; i++) {
-		if (cur[i].revents & (POLLIN|POLLPRI)) {
-			event = port_event(c->uds_rw_port, i);
-			if (EV_STATE_DECISION_EVENT == event) {
-				c->sde = 1;
+		/* Let the ports handle their events. */
+		if (!(revents & (EPOLLIN|EPOLLPRI|EPOLLERR))) {
+			continue;
+		}
+		prior_state = port_state(p);
+		if (pfd->index == FD_EVENT && port_txts_async(p) &&
+		    revents & (EPOLLPRI|EPOLLERR)) {
+			/* Transmit time stamps are pending. */
+			event = port_txts_event(p);
+			if (event == EV_NONE && revents & EPOLLIN) {
+				event = port_event(p, pfd->index);
 			}
+		} else if (revents & EPOLLERR) {
+			int error = sk_get_error(port_fda(p)->fd[pfd->index]);
+			pr_err("%s: error on fda[%d]: %s",
+			       port_log_name(p), pfd->index,
+			       strerror(error));
+			event = EV_FAULT_DETECTED;
+		} else {
+			event = port_event(p, pfd->index);
 		}
-	}
-	cur += N_CLOCK_PFD;
-	for (i = 0; i < N_POLLFD; i++) {
-		if (cur[i].revents & (POLLIN|POLLPRI)) {
-			event = port_event(c->uds_ro_port, i);
-			/* sde is not expected on the UDS-RO port */
+		if (EV_STATE_DECISION_EVENT == event) {
+			c->sde = 1;
+		}
+		if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
+			c->sde = 1;
+		}
+		port_dispatch(p, event, 0);
+		/* Clear any fault after a little while. */
+		if ((PS_FAULTY == port_state(p)) && (prior_state != PS_FAULTY)) {
+			clock_fault_timeout(p, 1);
+			/* Skip the other descriptors of the faulty port. */
+			for (j = i + 1; j < cnt; j++) {
+				other = ev[j].data.ptr;
+				if (other && other->port == p &&
+				    other->index != N_POLLFD) {
+					ev[j].data.ptr = NULL;
+				}
+			}
 		}
 	}
 
@@ -1878,18 +2453,23 @@ void clock_path_delay(struct clock *c, tmv_t req, tmv_t rx)
 	if (tsproc_update_delay(c->tsproc, &c->path_delay))
 		return;
 
+	servo_trace_delay(c->servo,
+			  tmv_to_nanoseconds(tsproc_raw_delay(c->tsproc)));
 	c->cur.meanPathDelay = tmv_to_TimeInterval(c->path_delay);
 
 	if (c->stats.delay)
 		stats_add_value(c->stats.delay, tmv_dbl(c->path_delay));
 }
 
-void clock_peer_delay(struct clock *c, tmv_t ppd, tmv_t req, tmv_t rx,
-		      double nrr)
+void clock_peer_delay(struct clock *c, tmv_t ppd, tmv_t raw, tmv_t req,
+		      tmv_t rx, double nrr)
 {
 	c->path_delay = ppd;
 	c->nrr = nrr;
 
+	if (!tmv_is_zero(raw))
+		servo_trace_delay(c->servo, tmv_to_nanoseconds(raw));
+
 	tsproc_set_delay(c->tsproc, ppd);
 	tsproc_up_ts(c->tsproc, req, rx);
 
@@ -1959,6 +2539,7 @@ int clock_switch_phc(struct clock *c, int phc_index)
 	c->clkid = clkid;
 	c->servo = servo;
 	c->servo_state = SERVO_UNLOCKED;
+	c->holdover.max_adj = max_adj;
 
 	pr_info("Switched to /dev/ptp%d as PTP clock", phc_index);
 
@@ -1990,11 +2571,15 @@ static int clock_synchronize_locked(struct clock *c, double adj)
 	return 0;
 }
 
-enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
+enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin,
+				   int *pending)
 {
 	enum servo_state state = SERVO_UNLOCKED;
 	double adj, weight;
 	int64_t offset;
+	int err;
+
+	*pending = 0;
 
 	if (c->step_window_counter) {
 		c->step_window_counter--;
@@ -2008,7 +2593,12 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 
 	tsproc_down_ts(c->tsproc, origin, ingress);
 
-	if (tsproc_update_offset(c->tsproc, &c->master_offset, &weight)) {
+	err = tsproc_update_offset(c->tsproc, &c->master_offset, &weight);
+	if (err > 0) {
+		*pending = 1;
+		return c->servo_state;
+	}
+	if (err) {
 		if (c->free_running) {
 			return clock_no_adjust(c, ingress, origin);
 		} else {
@@ -2028,8 +2618,10 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 		return state;
 	}
 
+	clock_holdover_exit(c);
 	offset = tmv_to_nanoseconds(c->master_offset);
-	adj = servo_sample(c->servo, offset, tmv_to_nanoseconds(ingress),
+	adj = servo_sample(c->servo, offset,
+			   tmv_to_nanoseconds(tsproc_offset_ts(c->tsproc)),
 			   weight, &state);
 	c->servo_state = state;
 
@@ -2058,6 +2650,8 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 		if (clock_synchronize_locked(c, adj)) {
 			goto servo_unlock;
 		}
+		clock_holdover_sample(c, adj);
+		clock_checkpoint_locked(c);
 		break;
 	case SERVO_LOCKED_STABLE:
 		if (c->write_phase_mode) {
@@ -2069,6 +2663,8 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 			if (clock_synchronize_locked(c, adj)) {
 				goto servo_unlock;
 			}
+			clock_holdover_sample(c, adj);
+			clock_checkpoint_locked(c);
 		}
 		break;
 	}
@@ -2119,7 +2715,8 @@ void clock_sync_interval(struct clock *c, int n)
 	}
 	c->stats.max_count = (1U << shift);
 
-	servo_sync_interval(c->servo, n < 0 ? 1.0 / (1 << -n) : 1 << n);
+	servo_sync_interval(c->servo, c->tsproc_select *
+			    (n < 0 ? 1.0 / (1 << -n) : 1 << n));
 }
 
 void clock_update_leap_status(struct clock *c)
@@ -2222,6 +2819,11 @@ static void handle_state_decision_event(struct clock *c)
 		}
 		c->ingress_ts = tmv_zero();
 		c->path_delay = c->initial_delay;
+		if (c->checkpoint.warm && best &&
+		    pid_eq(&best->dataset.sender, &c->checkpoint.parent)) {
+			c->path_delay = c->checkpoint.path_delay;
+			tsproc_set_delay(c->tsproc, c->path_delay);
+		}
 		c->master_local_rr = 1.0;
 		c->nrr = 1.0;
 		fresh_best = 1;
@@ -2237,6 +2839,14 @@ static void handle_state_decision_event(struct clock *c)
 	c->best = best;
 	c->best_id = best_id;
 
+	/* The warm start is over once a foreign master has been chosen. */
+	if (best) {
+		c->checkpoint.warm = 0;
+		LIST_FOREACH(piter, &c->ports, list) {
+			port_warm_end(piter);
+		}
+	}
+
 	LIST_FOREACH(piter, &c->ports, list) {
 		enum port_state ps;
 		enum fsm_event event;
@@ -173,10 +173,11 @@ struct ClockIdentity clock_identity(struct clock *c);
 
 /**
  * Informs clock that a file descriptor of one of its ports changed. The
- * clock will rebuild its array of file descriptors to poll.
+ * clock will add the port's open descriptors to its epoll set.
  * @param c    The clock instance.
+ * @param p    The port whose descriptors changed.
  */
-void clock_fda_changed(struct clock *c);
+void clock_fda_changed(struct clock *c, struct port *p);
 
 /**
  * Obtains the time of the latest synchronization.
@@ -240,12 +241,14 @@ void clock_path_delay(struct clock *c, tmv_t req, tmv_t rx);
  * Provide the estimated peer delay from a slave port.
  * @param c           The clock instance.
  * @param ppd         The peer delay as measured on a slave port.
+ * @param raw         The peer delay of the last exchange before filtering,
+ *                    or zero if it is not known.
  * @param req         The transmission time of the pdelay request message.
  * @param rx          The reception time of the pdelay request message.
  * @param nrr         The neighbor rate ratio as measured on a slave port.
  */
-void clock_peer_delay(struct clock *c, tmv_t ppd, tmv_t req, tmv_t rx,
-		      double nrr);
+void clock_peer_delay(struct clock *c, tmv_t ppd, tmv_t raw, tmv_t req,
+		      tmv_t rx, double nrr);
 
 /**
  * Set clock sde
@@ -334,10 +337,12 @@ int clock_switch_phc(struct clock *c, int phc_index);
  * @param correction1  The correction field of the sync message.
  * @param correction2  The correction field of the follow up message.
  *                     Pass zero in the case of one step operation.
+ * @param pending      Set to one when the data point was only buffered by
+ *                     the packet selection and the servo did not run.
  * @return             The state of the clock's servo.
  */
 enum servo_state clock_synchronize(struct clock *c, tmv_t ingress,
-				   tmv_t origin);
+				   tmv_t origin, int *pending);
 
 /**
  * Inform a slaved clock about the master's sync interval.
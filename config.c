@@ -146,6 +146,7 @@ static struct config_enum clock_servo_enu[] = {
 	{ "ntpshm", CLOCK_SERVO_NTPSHM },
 	{ "nullf",  CLOCK_SERVO_NULLF  },
 	{ "refclock_sock", CLOCK_SERVO_REFCLOCK_SOCK },
+	{ "kalman", CLOCK_SERVO_KALMAN },
 	{ NULL, 0 },
 };
 
@@ -166,6 +167,8 @@ static struct config_enum dataset_comp_enu[] = {
 static struct config_enum delay_filter_enu[] = {
 	{ "moving_average", FILTER_MOVING_AVERAGE },
 	{ "moving_median",  FILTER_MOVING_MEDIAN  },
+	{ "moving_minimum", FILTER_MOVING_MINIMUM },
+	{ "moving_percentile", FILTER_MOVING_PERCENTILE },
 	{ NULL, 0 },
 };
 
@@ -243,6 +246,8 @@ struct config_item config_tab[] = {
 	PORT_ITEM_INT("boundary_clock_jbod", 0, 0, 1),
 	PORT_ITEM_ENU("BMCA", BMCA_PTP, bmca_enu),
 	GLOB_ITEM_INT("check_fup_sync", 0, 0, 1),
+	GLOB_ITEM_STR("checkpoint_file", NULL),
+	GLOB_ITEM_INT("checkpoint_max_age", 60, 0, INT_MAX),
 	GLOB_ITEM_INT("clientOnly", 0, 0, 1),
 	GLOB_ITEM_INT("clockAccuracy", 0xfe, 0, UINT8_MAX),
 	GLOB_ITEM_INT("clockClass", 248, 0, UINT8_MAX),
@@ -259,6 +264,7 @@ struct config_item config_tab[] = {
 	PORT_ITEM_INT("delayAsymmetry", 0, INT_MIN, INT_MAX),
 	PORT_ITEM_ENU("delay_filter", FILTER_MOVING_MEDIAN, delay_filter_enu),
 	PORT_ITEM_INT("delay_filter_length", 10, 1, INT_MAX),
+	PORT_ITEM_INT("delay_filter_percentile", 10, 1, 100),
 	PORT_ITEM_ENU("delay_mechanism", DM_E2E, delay_mech_enu),
 	PORT_ITEM_INT("delay_response_timeout", 0, 0, UINT8_MAX),
 	GLOB_ITEM_INT("dscp_event", 0, 0, 63),
@@ -268,6 +274,9 @@ struct config_item config_tab[] = {
 	PORT_ITEM_INT("fault_badpeernet_interval", 16, INT32_MIN, INT32_MAX),
 	PORT_ITEM_INT("fault_reset_interval", 4, INT8_MIN, INT8_MAX),
 	GLOB_ITEM_DBL("first_step_threshold", 0.00002, 0.0, DBL_MAX),
+	PORT_ITEM_INT("fastLogMinDelayReqInterval", -4, INT8_MIN, INT8_MAX),
+	PORT_ITEM_INT("fastLogSyncInterval", -4, INT8_MIN, INT8_MAX),
+	PORT_ITEM_INT("fast_acquisition", 0, 0, 1),
 	PORT_ITEM_INT("follow_up_info", 0, 0, 1),
 	GLOB_ITEM_INT("free_running", 0, 0, 1),
 	PORT_ITEM_INT("freq_est_interval", 1, INT_MIN, INT_MAX),
@@ -275,6 +284,8 @@ struct config_item config_tab[] = {
 	PORT_ITEM_INT("G.8275.portDS.localPriority", 128, 1, UINT8_MAX),
 	GLOB_ITEM_INT("gmCapable", 1, 0, 1),
 	GLOB_ITEM_ENU("hwts_filter", HWTS_FILTER_NORMAL, hwts_filter_enu),
+	GLOB_ITEM_INT("holdover_clock_class", 0, 0, UINT8_MAX),
+	GLOB_ITEM_INT("holdover_interval", 0, 0, INT_MAX),
 	PORT_ITEM_INT("hybrid_e2e", 0, 0, 1),
 	PORT_ITEM_INT("ignore_source_id", 0, 0, 1),
 	PORT_ITEM_INT("ignore_transport_specific", 0, 0, 1),
@@ -284,7 +295,11 @@ struct config_item config_tab[] = {
 	PORT_ITEM_INT("inhibit_multicast_service", 0, 0, 1),
 	GLOB_ITEM_INT("initial_delay", 0, 0, INT_MAX),
 	PORT_ITEM_INT("interface_rate_tlv", 0, 0, 1),
+	GLOB_ITEM_DBL("kalman_drift_noise", 0.0, 0.0, DBL_MAX),
+	GLOB_ITEM_DBL("kalman_frequency_noise", 0.1, 0.0, DBL_MAX),
+	GLOB_ITEM_DBL("kalman_measurement_noise", 0.0, 0.0, DBL_MAX),
 	GLOB_ITEM_INT("kernel_leap", 1, 0, 1),
+	GLOB_ITEM_INT("lazy_tlv_parse", 0, 0, 1),
 	GLOB_ITEM_STR("leapfile", NULL),
 	PORT_ITEM_INT("logAnnounceInterval", 1, INT8_MIN, INT8_MAX),
 	PORT_ITEM_INT("logMinDelayReqInterval", 0, INT8_MIN, INT8_MAX),
@@ -293,6 +308,7 @@ struct config_item config_tab[] = {
 	GLOB_ITEM_INT("logging_level", LOG_INFO, PRINT_LEVEL_MIN, PRINT_LEVEL_MAX),
 	PORT_ITEM_INT("masterOnly", 0, 0, 1), /*deprecated*/
 	GLOB_ITEM_INT("maxStepsRemoved", 255, 2, UINT8_MAX),
+	GLOB_ITEM_INT("message_pool_size", 128, 0, 65536),
 	GLOB_ITEM_STR("message_tag", NULL),
 	GLOB_ITEM_STR("manufacturerIdentity", "00:00:00"),
 	GLOB_ITEM_INT("max_frequency", 900000000, 0, INT_MAX),
@@ -328,10 +344,15 @@ struct config_item config_tab[] = {
 	GLOB_ITEM_INT("ptp_minor_version", 1, 0, 1),
 	GLOB_ITEM_STR("refclock_sock_address", "/var/run/refclock.ptp.sock"),
 	GLOB_ITEM_STR("revisionData", ";;"),
+	PORT_ITEM_INT("rx_batch", 1, 1, TRANSPORT_BATCH_MAX),
 	GLOB_ITEM_INT("sanity_freq_limit", 200000000, 0, INT_MAX),
 	PORT_ITEM_INT("serverOnly", 0, 0, 1),
 	GLOB_ITEM_INT("servo_num_offset_values", 10, 0, INT_MAX),
 	GLOB_ITEM_INT("servo_offset_threshold", 0, 0, INT_MAX),
+	GLOB_ITEM_STR("servo_state_dir", NULL),
+	GLOB_ITEM_INT("servo_state_max_age", 3600, 0, INT_MAX),
+	GLOB_ITEM_STR("servo_trace_file", NULL),
+	GLOB_ITEM_INT("shared_src_sample", 0, 0, 1),
 	GLOB_ITEM_STR("slave_event_monitor", ""),
 	GLOB_ITEM_INT("slaveOnly", 0, 0, 1), /*deprecated*/
 	GLOB_ITEM_INT("socket_priority", 0, 0, 15),
@@ -339,6 +360,7 @@ struct config_item config_tab[] = {
 	GLOB_ITEM_INT("step_window", 0, 0, INT_MAX),
 	GLOB_ITEM_INT("summary_interval", 0, INT_MIN, INT_MAX),
 	PORT_ITEM_INT("syncReceiptTimeout", 0, 0, UINT8_MAX),
+	GLOB_ITEM_INT("sysoff_reprobe_interval", 0, 0, INT_MAX),
 	GLOB_ITEM_INT("tc_spanning_tree", 0, 0, 1),
 	GLOB_ITEM_INT("timeSource", INTERNAL_OSCILLATOR, 0x10, 0xfe),
 	GLOB_ITEM_ENU("time_stamping", TS_HARDWARE, timestamping_enu),
@@ -356,7 +378,10 @@ struct config_item config_tab[] = {
 	GLOB_ITEM_INT("ts2phc.pulsewidth", 500000000, 1000000, 999000000),
 	GLOB_ITEM_STR("ts2phc.tod_source", "generic"),
 	PORT_ITEM_ENU("tsproc_mode", TSPROC_FILTER, tsproc_enu),
+	PORT_ITEM_INT("tsproc_select_count", 1, 1, INT_MAX),
+	PORT_ITEM_INT("tsproc_select_length", 0, 0, INT_MAX),
 	GLOB_ITEM_INT("twoStepFlag", 1, 0, 1),
+	GLOB_ITEM_INT("tx_timestamp_async", 0, 0, 1),
 	GLOB_ITEM_INT("tx_timestamp_timeout", 10, 1, INT_MAX),
 	PORT_ITEM_INT("udp_ttl", 1, 1, 255),
 	PORT_ITEM_INT("udp6_scope", 0x0E, 0x00, 0x0F),
@@ -367,6 +392,9 @@ struct config_item config_tab[] = {
 	PORT_ITEM_INT("unicast_listen", 0, 0, 1),
 	PORT_ITEM_INT("unicast_master_table", 0, 0, INT_MAX),
 	PORT_ITEM_INT("unicast_req_duration", 3600, 10, INT_MAX),
+	PORT_ITEM_DBL("update_rate", 0.0, 0.0, DBL_MAX),
+	PORT_ITEM_INT("update_thread", 0, 0, 1),
+	PORT_ITEM_INT("update_thread_cpu", -1, -1, INT_MAX),
 	GLOB_ITEM_INT("use_syslog", 1, 0, 1),
 	GLOB_ITEM_STR("userDescription", ""),
 	GLOB_ITEM_INT("utc_offset", CURRENT_UTC_OFFSET, 0, INT_MAX),
@@ -120,6 +120,27 @@ struct PortServiceStats {
 	uint64_t followup_mismatch;
 };
 
+struct MessagePoolStats {
+	uint64_t capacity;
+	uint64_t allocated;
+	uint64_t in_use;
+	uint64_t max_in_use;
+	uint64_t heap_allocations;
+	uint64_t alloc_failures;
+};
+
+#define STATS_HISTOGRAM_BINS 40
+
+/* Absolute values in nanoseconds, bin i counts those below 2^i. */
+struct StatsHistogram {
+	uint64_t count;
+	int64_t p50;
+	int64_t p99;
+	int64_t p999;
+	int64_t max;
+	uint32_t bins[STATS_HISTOGRAM_BINS];
+} PACKED;
+
 struct unicast_master_entry {
 	struct PortIdentity     port_identity;
 	struct ClockQuality     clock_quality;
@@ -121,6 +121,10 @@ enum fsm_event e2e_event(struct port *p, int fd_index)
 		pr_err("unexpected timer expiration");
 		return EV_NONE;
 
+	case FD_TXTS_TIMER:
+		pr_debug("%s: tx timestamp timeout", p->log_name);
+		return port_txts_timeout(p);
+
 	case FD_RTNL:
 		pr_debug("%s: received link status notification", p->log_name);
 		rtnl_link_status(fd, p->name, port_link_status, p);
@@ -134,7 +138,7 @@ enum fsm_event e2e_event(struct port *p, int fd_index)
 		}
 	}
 
-	msg = msg_allocate();
+	msg = msg_allocate_recv();
 	if (!msg) {
 		return EV_FAULT_DETECTED;
 	}
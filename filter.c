@@ -20,14 +20,20 @@
 #include "filter_private.h"
 #include "mave.h"
 #include "mmedian.h"
+#include "mmin.h"
 
-struct filter *filter_create(enum filter_type type, int length)
+struct filter *filter_create(enum filter_type type, int length,
+			     int percentile)
 {
 	switch (type) {
 	case FILTER_MOVING_AVERAGE:
 		return mave_create(length);
 	case FILTER_MOVING_MEDIAN:
 		return mmedian_create(length);
+	case FILTER_MOVING_MINIMUM:
+		return mmin_create(length);
+	case FILTER_MOVING_PERCENTILE:
+		return mpercentile_create(length, percentile);
 	default:
 		return NULL;
 	}
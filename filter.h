@@ -31,15 +31,19 @@ struct filter;
 enum filter_type {
 	FILTER_MOVING_AVERAGE,
 	FILTER_MOVING_MEDIAN,
+	FILTER_MOVING_MINIMUM,
+	FILTER_MOVING_PERCENTILE,
 };
 
 /**
  * Create a new instance of a filter.
- * @param type    The type of the filter to create.
- * @param length  The filter's length.
+ * @param type        The type of the filter to create.
+ * @param length      The filter's length.
+ * @param percentile  The percentile tracked by FILTER_MOVING_PERCENTILE.
  * @return A pointer to a new filter on success, NULL otherwise.
  */
-struct filter *filter_create(enum filter_type type, int length);
+struct filter *filter_create(enum filter_type type, int length,
+			     int percentile);
 
 /**
  * Destroy an instance of a filter.
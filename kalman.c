@@ -0,0 +1,296 @@
+/**
+ * @file kalman.c
+ * @brief Implements a servo based on a Kalman filter.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include <math.h>
+
+#include "config.h"
+#include "kalman.h"
+#include "print.h"
+#include "servo_private.h"
+
+/* Default measurement noise in nanoseconds */
+#define HWTS_MEAS_NOISE 20.0
+#define SWTS_MEAS_NOISE 5000.0
+
+/* Initial uncertainty of the frequency in ppb */
+#define INITIAL_FREQ_NOISE 100000.0
+
+/* Number of sync intervals over which the phase is corrected */
+#define CORR_INTERVALS 4.0
+
+/* Lowest accepted weight of a measurement */
+#define MIN_WEIGHT 0.001
+
+/*
+ * The state is the offset of the clock in ns, its uncorrected frequency
+ * offset in ppb, and optionally the drift of the frequency in ppb/s.
+ * Between the measurements, the offset changes by the difference of the
+ * frequency offset and the frequency correction applied to the clock.
+ */
+#define STATE_SIZE 3
+
+struct kalman_servo {
+	struct servo servo;
+	double x[STATE_SIZE];
+	double P[STATE_SIZE][STATE_SIZE];
+	/* Frequency correction applied since the last sample */
+	double last_freq;
+	uint64_t last_ts;
+	int count;
+	double update_interval;
+	/* configuration: */
+	double meas_noise;
+	double freq_noise;
+	double drift_noise;
+};
+
+static void kalman_destroy(struct servo *servo)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+	free(s);
+}
+
+static void kalman_init(struct kalman_servo *s, int64_t offset, double var)
+{
+	int i, j;
+
+	for (i = 0; i < STATE_SIZE; i++) {
+		s->x[i] = 0.0;
+		for (j = 0; j < STATE_SIZE; j++)
+			s->P[i][j] = 0.0;
+	}
+	s->x[0] = offset;
+	s->x[1] = s->last_freq;
+	s->P[0][0] = var;
+	s->P[1][1] = INITIAL_FREQ_NOISE * INITIAL_FREQ_NOISE;
+}
+
+static void kalman_predict(struct kalman_servo *s, double dt)
+{
+	double F[STATE_SIZE][STATE_SIZE] = {
+		{ 1.0, dt, dt * dt / 2.0 },
+		{ 0.0, 1.0, dt },
+		{ 0.0, 0.0, 1.0 },
+	};
+	double FP[STATE_SIZE][STATE_SIZE], x[STATE_SIZE];
+	double qf = s->freq_noise * s->freq_noise;
+	double qd = s->drift_noise * s->drift_noise;
+	int i, j, k;
+
+	for (i = 0; i < STATE_SIZE; i++) {
+		x[i] = 0.0;
+		for (k = 0; k < STATE_SIZE; k++)
+			x[i] += F[i][k] * s->x[k];
+	}
+	x[0] -= s->last_freq * dt;
+	for (i = 0; i < STATE_SIZE; i++)
+		s->x[i] = x[i];
+
+	/* P = F * P * F' + Q */
+	for (i = 0; i < STATE_SIZE; i++) {
+		for (j = 0; j < STATE_SIZE; j++) {
+			FP[i][j] = 0.0;
+			for (k = 0; k < STATE_SIZE; k++)
+				FP[i][j] += F[i][k] * s->P[k][j];
+		}
+	}
+	for (i = 0; i < STATE_SIZE; i++) {
+		for (j = 0; j < STATE_SIZE; j++) {
+			s->P[i][j] = 0.0;
+			for (k = 0; k < STATE_SIZE; k++)
+				s->P[i][j] += FP[i][k] * F[j][k];
+		}
+	}
+
+	/* Random walk of the frequency and of the drift */
+	s->P[0][0] += qf * dt * dt * dt / 3.0 + qd * dt * dt * dt * dt * dt / 20.0;
+	s->P[0][1] += qf * dt * dt / 2.0 + qd * dt * dt * dt * dt / 8.0;
+	s->P[1][0] = s->P[0][1];
+	s->P[1][1] += qf * dt + qd * dt * dt * dt / 3.0;
+	if (s->drift_noise) {
+		s->P[0][2] += qd * dt * dt * dt / 6.0;
+		s->P[2][0] = s->P[0][2];
+		s->P[1][2] += qd * dt * dt / 2.0;
+		s->P[2][1] = s->P[1][2];
+		s->P[2][2] += qd * dt;
+	}
+}
+
+static void kalman_update(struct kalman_servo *s, double z, double r)
+{
+	double K[STATE_SIZE], P0[STATE_SIZE], y, S;
+	int i, j;
+
+	y = z - s->x[0];
+	S = s->P[0][0] + r;
+
+	for (i = 0; i < STATE_SIZE; i++) {
+		K[i] = s->P[i][0] / S;
+		P0[i] = s->P[0][i];
+	}
+	for (i = 0; i < STATE_SIZE; i++) {
+		s->x[i] += K[i] * y;
+		for (j = 0; j < STATE_SIZE; j++)
+			s->P[i][j] -= K[i] * P0[j];
+	}
+}
+
+static double kalman_sample(struct servo *servo,
+			    int64_t offset,
+			    uint64_t local_ts,
+			    double weight,
+			    enum servo_state *state)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+	double dt, r, ppb;
+
+	if (weight < MIN_WEIGHT)
+		weight = MIN_WEIGHT;
+	r = s->meas_noise * s->meas_noise / weight;
+
+	if (s->count && local_ts <= s->last_ts)
+		s->count = 0;
+
+	if (servo->step_threshold &&
+	    servo->step_threshold < llabs(offset) && s->count > 1)
+		s->count = 0;
+
+	switch (s->count) {
+	case 0:
+		kalman_init(s, offset, r);
+		s->last_ts = local_ts;
+		s->count = 1;
+		*state = SERVO_UNLOCKED;
+		return s->last_freq;
+	case 1:
+		dt = (local_ts - s->last_ts) / 1e9;
+		kalman_predict(s, dt);
+		kalman_update(s, offset, r);
+		s->count = 2;
+		if ((servo->first_update &&
+		     servo->first_step_threshold &&
+		     servo->first_step_threshold < llabs(offset)) ||
+		    (servo->step_threshold &&
+		     servo->step_threshold < llabs(offset))) {
+			/* The clock will be stepped by offset. */
+			s->x[0] -= offset;
+			*state = SERVO_JUMP;
+		} else {
+			*state = SERVO_LOCKED;
+		}
+		break;
+	default:
+		dt = (local_ts - s->last_ts) / 1e9;
+		kalman_predict(s, dt);
+		kalman_update(s, offset, r);
+		*state = SERVO_LOCKED;
+		break;
+	}
+	s->last_ts = local_ts;
+
+	/* Cancel the frequency offset and correct the remaining offset. */
+	ppb = s->x[1] + s->x[2] * s->update_interval / 2.0 +
+		s->x[0] / (s->update_interval * CORR_INTERVALS);
+
+	if (ppb < -servo->max_frequency)
+		ppb = -servo->max_frequency;
+	else if (ppb > servo->max_frequency)
+		ppb = servo->max_frequency;
+
+	if (*state == SERVO_LOCKED && servo->offset_threshold &&
+	    sqrt(s->P[0][0]) < servo->offset_threshold &&
+	    fabs(s->x[0]) < servo->offset_threshold)
+		*state = SERVO_LOCKED_STABLE;
+
+	pr_debug("kalman: offset %.1f +/- %.1f freq %.3f +/- %.3f drift %.6f",
+		 s->x[0], sqrt(s->P[0][0]), s->x[1], sqrt(s->P[1][1]), s->x[2]);
+
+	s->last_freq = ppb;
+	return ppb;
+}
+
+static void kalman_sync_interval(struct servo *servo, double interval)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	s->update_interval = interval;
+}
+
+static void kalman_reset(struct servo *servo)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	s->count = 0;
+}
+
+static double kalman_rate_ratio(struct servo *servo)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	if (s->count < 2)
+		return 1.0;
+
+	return 1.0 / (1.0 + (s->x[1] - s->last_freq) / 1e9);
+}
+
+static double kalman_frequency(struct servo *servo)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	if (s->count < 2)
+		return s->last_freq;
+
+	return s->x[1];
+}
+
+static void kalman_seed(struct servo *servo, double fadj)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	s->last_freq = fadj;
+}
+
+struct servo *kalman_servo_create(struct config *cfg, double fadj, int sw_ts)
+{
+	struct kalman_servo *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+
+	s->servo.destroy = kalman_destroy;
+	s->servo.sample = kalman_sample;
+	s->servo.sync_interval = kalman_sync_interval;
+	s->servo.reset = kalman_reset;
+	s->servo.rate_ratio = kalman_rate_ratio;
+	s->servo.frequency = kalman_frequency;
+	s->servo.seed = kalman_seed;
+
+	s->last_freq = fadj;
+	s->update_interval = 1.0;
+	s->meas_noise = config_get_double(cfg, NULL, "kalman_measurement_noise");
+	s->freq_noise = config_get_double(cfg, NULL, "kalman_frequency_noise");
+	s->drift_noise = config_get_double(cfg, NULL, "kalman_drift_noise");
+
+	if (!s->meas_noise)
+		s->meas_noise = sw_ts ? SWTS_MEAS_NOISE : HWTS_MEAS_NOISE;
+
+	return &s->servo;
+}
@@ -26,7 +26,7 @@
 
 /* Maximum and minimum number of points used in regression,
    defined as a power of 2 */
-#define MAX_SIZE 6
+#define MAX_SIZE 10
 #define MIN_SIZE 2
 
 #define MAX_POINTS (1 << MAX_SIZE)
@@ -37,6 +37,8 @@
 #define ERR_INITIAL_UPDATES 10
 /* Maximum ratio of two err values to be considered equal */
 #define ERR_EQUALS 1.05
+/* Number of updates after which the sums are recalculated */
+#define SUMS_REFRESH MAX_POINTS
 
 /* Uncorrected local time vs remote time */
 struct point {
@@ -45,7 +47,18 @@ struct point {
 	double w;
 };
 
+/* Weighted sums of points relative to the reference */
+struct sums {
+	double x;
+	double y;
+	double xy;
+	double x2;
+	double w;
+};
+
 struct result {
+	/* Sums of the points in the window of this size */
+	struct sums sums;
 	/* Slope and intercept from latest regression */
 	double slope;
 	double intercept;
@@ -65,6 +78,8 @@ struct linreg_servo {
 	unsigned int num_points;
 	/* Index of the newest point */
 	unsigned int last_point;
+	/* Number of updates of the sums since their calculation */
+	unsigned int sums_updates;
 	/* Remainder from last update of reference.x */
 	double x_remainder;
 	/* Local time stamp of last update */
@@ -75,6 +90,8 @@ struct linreg_servo {
 	unsigned int size;
 	/* Current frequency offset of the clock */
 	double clock_freq;
+	/* Frequency offset given by the slope, without the time correction */
+	double slope_freq;
 	/* Expected interval between updates */
 	double update_interval;
 	/* Current ratio between remote and local frequency */
@@ -89,6 +106,59 @@ static void linreg_destroy(struct servo *servo)
 	free(s);
 }
 
+static void sums_point(struct linreg_servo *s, struct sums *sums,
+		       unsigned int index, double sign)
+{
+	struct point *p = &s->points[index];
+	double x, y, w;
+
+	x = (int64_t)(p->x - s->reference.x);
+	y = (int64_t)(p->y - s->reference.y);
+	w = p->w * sign;
+
+	sums->x += x * w;
+	sums->y += y * w;
+	sums->xy += x * y * w;
+	sums->x2 += x * x * w;
+	sums->w += w;
+}
+
+static void sums_move(struct sums *sums, double x, double y)
+{
+	/* Expand the sums of (x_i - x) and (y_i - y) */
+	sums->xy += x * y * sums->w - x * sums->y - y * sums->x;
+	sums->x2 += x * x * sums->w - 2.0 * x * sums->x;
+	sums->x -= x * sums->w;
+	sums->y -= y * sums->w;
+}
+
+/*
+ * Calculate the sums of all sizes from scratch, which limits the
+ * accumulation of rounding errors in the incremental updates.
+ */
+static void sums_refresh(struct linreg_servo *s)
+{
+	struct sums sums = { 0 };
+	unsigned int i, l, n, size;
+
+	i = 0;
+
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		n = 1 << size;
+		if (n > s->num_points)
+			n = s->num_points;
+
+		for (; i < n; i++) {
+			/* Iterate points from newest to oldest */
+			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
+			sums_point(s, &sums, l, 1.0);
+		}
+		s->results[size - MIN_SIZE].sums = sums;
+	}
+
+	s->sums_updates = 0;
+}
+
 static void move_reference(struct linreg_servo *s, int64_t x, int64_t y)
 {
 	struct result *res;
@@ -97,10 +167,11 @@ static void move_reference(struct linreg_servo *s, int64_t x, int64_t y)
 	s->reference.x += x;
 	s->reference.y += y;
 
-	/* Update intercepts for new reference */
+	/* Update intercepts and sums for new reference */
 	for (i = MIN_SIZE; i <= MAX_SIZE; i++) {
 		res = &s->results[i - MIN_SIZE];
 		res->intercept += x * res->slope - y;
+		sums_move(&res->sums, x, y);
 	}
 }
 
@@ -125,25 +196,43 @@ static void update_reference(struct linreg_servo *s, uint64_t local_ts)
 
 static void add_sample(struct linreg_servo *s, int64_t offset, double weight)
 {
+	unsigned int l, n, size;
+
 	s->last_point = (s->last_point + 1) % MAX_POINTS;
 
+	/* Remove the points leaving the windows, before overwriting one */
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		n = 1 << size;
+		if (n > s->num_points)
+			break;
+		l = (MAX_POINTS + s->last_point - n) % MAX_POINTS;
+		sums_point(s, &s->results[size - MIN_SIZE].sums, l, -1.0);
+	}
+
 	s->points[s->last_point].x = s->reference.x;
 	s->points[s->last_point].y = s->reference.y - offset;
 	s->points[s->last_point].w = weight;
 
 	if (s->num_points < MAX_POINTS)
 		s->num_points++;
+
+	if (++s->sums_updates >= SUMS_REFRESH) {
+		sums_refresh(s);
+		return;
+	}
+
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++)
+		sums_point(s, &s->results[size - MIN_SIZE].sums,
+			   s->last_point, 1.0);
 }
 
 static void regress(struct linreg_servo *s)
 {
-	double x, y, y0, e, x_sum, y_sum, xy_sum, x2_sum, w, w_sum;
-	unsigned int i, l, n, size;
+	double y0, e;
+	unsigned int n, size;
+	struct sums *sums;
 	struct result *res;
 
-	x_sum = 0.0, y_sum = 0.0, xy_sum = 0.0, x2_sum = 0.0; w_sum = 0.0;
-	i = 0;
-
 	y0 = (int64_t)(s->points[s->last_point].y - s->reference.y);
 
 	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
@@ -167,25 +256,11 @@ static void regress(struct linreg_servo *s)
 			}
 		}
 
-		for (; i < n; i++) {
-			/* Iterate points from newest to oldest */
-			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
-
-			x = (int64_t)(s->points[l].x - s->reference.x);
-			y = (int64_t)(s->points[l].y - s->reference.y);
-			w = s->points[l].w;
-
-			x_sum += x * w;
-			y_sum += y * w;
-			xy_sum += x * y * w;
-			x2_sum += x * x * w;
-			w_sum += w;
-		}
-
 		/* Get new intercept and slope */
-		res->slope = (xy_sum - x_sum * y_sum / w_sum) /
-				(x2_sum - x_sum * x_sum / w_sum);
-		res->intercept = (y_sum - res->slope * x_sum) / w_sum;
+		sums = &res->sums;
+		res->slope = (sums->xy - sums->x * sums->y / sums->w) /
+				(sums->x2 - sums->x * sums->x / sums->w);
+		res->intercept = (sums->y - res->slope * sums->x) / sums->w;
 	}
 }
 
@@ -263,6 +338,7 @@ static double linreg_sample(struct servo *servo,
 
 	/* Set clock frequency to the slope */
 	s->clock_freq = 1e9 * (res->slope - 1.0);
+	s->slope_freq = s->clock_freq;
 
 	/*
 	 * Adjust the frequency to correct the time offset. Use longer
@@ -299,11 +375,13 @@ static void linreg_reset(struct servo *servo)
 	unsigned int i;
 
 	s->num_points = 0;
+	s->sums_updates = 0;
 	s->last_update = 0;
 	s->size = 0;
 	s->frequency_ratio = 1.0;
 
 	for (i = MIN_SIZE; i <= MAX_SIZE; i++) {
+		s->results[i - MIN_SIZE].sums = (struct sums) { 0 };
 		s->results[i - MIN_SIZE].slope = 0.0;
 		s->results[i - MIN_SIZE].err_updates = 0;
 	}
@@ -316,6 +394,21 @@ static double linreg_rate_ratio(struct servo *servo)
 	return s->frequency_ratio;
 }
 
+static double linreg_frequency(struct servo *servo)
+{
+	struct linreg_servo *s = container_of(servo, struct linreg_servo, servo);
+
+	return -s->slope_freq;
+}
+
+static void linreg_seed(struct servo *servo, double fadj)
+{
+	struct linreg_servo *s = container_of(servo, struct linreg_servo, servo);
+
+	s->clock_freq = -fadj;
+	s->slope_freq = -fadj;
+}
+
 static void linreg_leap(struct servo *servo, int leap)
 {
 	struct linreg_servo *s = container_of(servo, struct linreg_servo, servo);
@@ -343,9 +436,12 @@ struct servo *linreg_servo_create(double fadj)
 	s->servo.sync_interval = linreg_sync_interval;
 	s->servo.reset = linreg_reset;
 	s->servo.rate_ratio = linreg_rate_ratio;
+	s->servo.frequency = linreg_frequency;
+	s->servo.seed = linreg_seed;
 	s->servo.leap = linreg_leap;
 
 	s->clock_freq = -fadj;
+	s->slope_freq = -fadj;
 	s->frequency_ratio = 1.0;
 
 	return &s->servo;
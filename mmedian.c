@@ -22,21 +22,117 @@
 #include "mmedian.h"
 #include "filter_private.h"
 
+/*
+ * The window is split into two binary heaps of sample indices, a max
+ * heap holding the lower half of the values and a min heap holding the
+ * upper half, so the median is always found at the top of the heaps.
+ * Each sample remembers its position in its heap, which allows the
+ * oldest sample to be replaced in O(log n) time.  Other percentiles
+ * are tracked by changing the share of the samples in the lower heap.
+ */
+struct mheap {
+	int *idx;
+	int cnt;
+	/* +1 for a max heap, -1 for a min heap. */
+	int sign;
+};
+
 struct mmedian {
 	struct filter filter;
 	int cnt;
 	int len;
 	int index;
-	/* Indices sorted by value. */
-	int *order;
+	int percentile;
+	struct mheap lo;
+	struct mheap hi;
+	/* Position of each sample in its heap. */
+	int *pos;
+	/* Heap holding each sample. */
+	struct mheap **owner;
 	/* Values stored in circular buffer. */
 	tmv_t *samples;
 };
 
+static int mheap_before(struct mmedian *m, struct mheap *h, int a, int b)
+{
+	return h->sign * tmv_cmp(m->samples[a], m->samples[b]) > 0;
+}
+
+static void mheap_set(struct mmedian *m, struct mheap *h, int i, int index)
+{
+	h->idx[i] = index;
+	m->pos[index] = i;
+	m->owner[index] = h;
+}
+
+static void mheap_sift_up(struct mmedian *m, struct mheap *h, int i)
+{
+	int index = h->idx[i], parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!mheap_before(m, h, index, h->idx[parent]))
+			break;
+		mheap_set(m, h, i, h->idx[parent]);
+		i = parent;
+	}
+	mheap_set(m, h, i, index);
+}
+
+static void mheap_sift_down(struct mmedian *m, struct mheap *h, int i)
+{
+	int index = h->idx[i], child;
+
+	while ((child = 2 * i + 1) < h->cnt) {
+		if (child + 1 < h->cnt &&
+		    mheap_before(m, h, h->idx[child + 1], h->idx[child]))
+			child++;
+		if (!mheap_before(m, h, h->idx[child], index))
+			break;
+		mheap_set(m, h, i, h->idx[child]);
+		i = child;
+	}
+	mheap_set(m, h, i, index);
+}
+
+static void mheap_push(struct mmedian *m, struct mheap *h, int index)
+{
+	mheap_set(m, h, h->cnt++, index);
+	mheap_sift_up(m, h, h->cnt - 1);
+}
+
+static int mheap_pop(struct mmedian *m, struct mheap *h)
+{
+	int top = h->idx[0];
+
+	h->cnt--;
+	if (h->cnt) {
+		mheap_set(m, h, 0, h->idx[h->cnt]);
+		mheap_sift_down(m, h, 0);
+	}
+	return top;
+}
+
+static tmv_t mheap_top(struct mmedian *m, struct mheap *h)
+{
+	return m->samples[h->idx[0]];
+}
+
+/* Number of samples in the lower heap. */
+static int mmedian_rank(struct mmedian *m)
+{
+	int rank = (m->cnt * m->percentile + 99) / 100;
+
+	return rank ? rank : 1;
+}
+
 static void mmedian_destroy(struct filter *filter)
 {
 	struct mmedian *m = container_of(filter, struct mmedian, filter);
-	free(m->order);
+	free(m->lo.idx);
+	free(m->hi.idx);
+	free(m->pos);
+	free(m->owner);
 	free(m->samples);
 	free(m);
 }
@@ -44,36 +140,46 @@ static void mmedian_destroy(struct filter *filter)
 static tmv_t mmedian_sample(struct filter *filter, tmv_t sample)
 {
 	struct mmedian *m = container_of(filter, struct mmedian, filter);
-	int i;
+	struct mheap *h;
+	int lo, hi;
 
 	m->samples[m->index] = sample;
 	if (m->cnt < m->len) {
 		m->cnt++;
+		if (!m->lo.cnt || tmv_cmp(sample, mheap_top(m, &m->lo)) <= 0)
+			mheap_push(m, &m->lo, m->index);
+		else
+			mheap_push(m, &m->hi, m->index);
+
+		if (m->lo.cnt > mmedian_rank(m))
+			mheap_push(m, &m->hi, mheap_pop(m, &m->lo));
+		else if (m->lo.cnt < mmedian_rank(m))
+			mheap_push(m, &m->lo, mheap_pop(m, &m->hi));
 	} else {
-		/* Remove index of the replaced value from order. */
-		for (i = 0; i < m->cnt; i++)
-			if (m->order[i] == m->index)
-				break;
-		for (; i + 1 < m->cnt; i++)
-			m->order[i] = m->order[i + 1];
-	}
+		/* The new value replaces the oldest one in its heap. */
+		h = m->owner[m->index];
+		mheap_sift_up(m, h, m->pos[m->index]);
+		mheap_sift_down(m, h, m->pos[m->index]);
 
-	/* Insert index of the new value to order. */
-	for (i = m->cnt - 1; i > 0; i--) {
-		if (tmv_cmp(m->samples[m->order[i - 1]],
-			    m->samples[m->index]) <= 0)
-			break;
-		m->order[i] = m->order[i - 1];
+		/* Only the tops can be out of order now, swap them. */
+		if (m->hi.cnt &&
+		    tmv_cmp(mheap_top(m, &m->lo), mheap_top(m, &m->hi)) > 0) {
+			lo = m->lo.idx[0];
+			hi = m->hi.idx[0];
+			mheap_set(m, &m->lo, 0, hi);
+			mheap_set(m, &m->hi, 0, lo);
+			mheap_sift_down(m, &m->lo, 0);
+			mheap_sift_down(m, &m->hi, 0);
+		}
 	}
-	m->order[i] = m->index;
 
 	m->index = (1 + m->index) % m->len;
 
-	if (m->cnt % 2)
-		return m->samples[m->order[m->cnt / 2]];
+	if (m->percentile != 50 || m->cnt % 2)
+		return mheap_top(m, &m->lo);
 	else
-		return tmv_div(tmv_add(m->samples[m->order[m->cnt / 2 - 1]],
-				       m->samples[m->order[m->cnt / 2]]), 2);
+		return tmv_div(tmv_add(mheap_top(m, &m->lo),
+				       mheap_top(m, &m->hi)), 2);
 }
 
 static void mmedian_reset(struct filter *filter)
@@ -81,13 +187,20 @@ static void mmedian_reset(struct filter *filter)
 	struct mmedian *m = container_of(filter, struct mmedian, filter);
 	m->cnt = 0;
 	m->index = 0;
+	m->lo.cnt = 0;
+	m->hi.cnt = 0;
 }
 
 struct filter *mmedian_create(int length)
+{
+	return mpercentile_create(length, 50);
+}
+
+struct filter *mpercentile_create(int length, int percentile)
 {
 	struct mmedian *m;
 
-	if (length < 1)
+	if (length < 1 || percentile < 1 || percentile > 100)
 		return NULL;
 	m = calloc(1, sizeof(*m));
 	if (!m)
@@ -95,17 +208,18 @@ struct filter *mmedian_create(int length)
 	m->filter.destroy = mmedian_destroy;
 	m->filter.sample = mmedian_sample;
 	m->filter.reset = mmedian_reset;
-	m->order = calloc(1, length * sizeof(*m->order));
-	if (!m->order) {
-		free(m);
-		return NULL;
-	}
-	m->samples = calloc(1, length * sizeof(*m->samples));
-	if (!m->samples) {
-		free(m->order);
-		free(m);
+	m->lo.idx = calloc(length, sizeof(*m->lo.idx));
+	m->lo.sign = 1;
+	m->hi.idx = calloc(length, sizeof(*m->hi.idx));
+	m->hi.sign = -1;
+	m->pos = calloc(length, sizeof(*m->pos));
+	m->owner = calloc(length, sizeof(*m->owner));
+	m->samples = calloc(length, sizeof(*m->samples));
+	if (!m->lo.idx || !m->hi.idx || !m->pos || !m->owner || !m->samples) {
+		mmedian_destroy(&m->filter);
 		return NULL;
 	}
 	m->len = length;
+	m->percentile = percentile;
 	return &m->filter;
 }
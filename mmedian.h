@@ -24,4 +24,14 @@
 
 struct filter *mmedian_create(int length);
 
+/**
+ * Create a moving percentile filter.  The output is the k-th smallest
+ * sample in the window, k being the given percentage of the number of
+ * samples rounded up.
+ * @param length      The filter's length.
+ * @param percentile  The percentile to track, 1 to 100.
+ * @return A pointer to a new filter on success, NULL otherwise.
+ */
+struct filter *mpercentile_create(int length, int percentile);
+
 #endif
@@ -0,0 +1,104 @@
+/**
+ * @file mmin.c
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+
+#include "mmin.h"
+#include "filter_private.h"
+
+/*
+ * The samples which may still become the minimum of the window are
+ * kept in a deque, in increasing order of both age and value.  Every
+ * sample enters and leaves the deque once, so the cost per sample is
+ * constant on average.
+ */
+struct mmin {
+	struct filter filter;
+	unsigned int len;
+	/* Sequence number of the next sample. */
+	unsigned int seq;
+	/* Deque stored in circular buffer. */
+	int head;
+	int cnt;
+	unsigned int *seqs;
+	tmv_t *samples;
+};
+
+static void mmin_destroy(struct filter *filter)
+{
+	struct mmin *m = container_of(filter, struct mmin, filter);
+	free(m->seqs);
+	free(m->samples);
+	free(m);
+}
+
+static tmv_t mmin_sample(struct filter *filter, tmv_t sample)
+{
+	struct mmin *m = container_of(filter, struct mmin, filter);
+	int tail;
+
+	/* Drop the oldest sample once it leaves the window. */
+	if (m->cnt && m->seq - m->seqs[m->head] >= m->len) {
+		m->head = (m->head + 1) % m->len;
+		m->cnt--;
+	}
+
+	/* Drop the samples which can no longer be the minimum. */
+	while (m->cnt) {
+		tail = (m->head + m->cnt - 1) % m->len;
+		if (tmv_cmp(m->samples[tail], sample) < 0)
+			break;
+		m->cnt--;
+	}
+
+	tail = (m->head + m->cnt) % m->len;
+	m->samples[tail] = sample;
+	m->seqs[tail] = m->seq++;
+	m->cnt++;
+
+	return m->samples[m->head];
+}
+
+static void mmin_reset(struct filter *filter)
+{
+	struct mmin *m = container_of(filter, struct mmin, filter);
+	m->head = 0;
+	m->cnt = 0;
+}
+
+struct filter *mmin_create(int length)
+{
+	struct mmin *m;
+
+	if (length < 1)
+		return NULL;
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+	m->filter.destroy = mmin_destroy;
+	m->filter.sample = mmin_sample;
+	m->filter.reset = mmin_reset;
+	m->seqs = calloc(length, sizeof(*m->seqs));
+	m->samples = calloc(length, sizeof(*m->samples));
+	if (!m->seqs || !m->samples) {
+		mmin_destroy(&m->filter);
+		return NULL;
+	}
+	m->len = length;
+	return &m->filter;
+}
@@ -18,7 +18,9 @@
  */
 #include <arpa/inet.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <malloc.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -29,6 +31,7 @@
 #include "tlv.h"
 
 int assume_two_step = 0;
+int lazy_tlv_parse = 0;
 uint8_t ptp_hdr_ver = PTP_VERSION;
 
 /*
@@ -41,26 +44,96 @@ struct message_storage {
 	struct ptp_message msg __attribute__((aligned (8)));
 };
 
-static TAILQ_HEAD(msg_pool, ptp_message) msg_pool = TAILQ_HEAD_INITIALIZER(msg_pool);
+/*
+ * A pool keeps its free messages on a list.  The messages of the
+ * slab are allocated up front, and once they are all in use the pool
+ * falls back to malloc().  Messages from the heap are freed when they
+ * are released, unless the pool has no slab at all, in which case it
+ * grows as needed and never shrinks.
+ *
+ * There is a single pool, used by whoever calls msg_allocate(), but
+ * all of the state lives in the structure, so that each thread could
+ * be given a pool of its own.
+ */
+struct msg_pool {
+	TAILQ_HEAD(msg_free, ptp_message) free;
+	struct message_storage *slab;
+	int capacity;
+	struct MessagePoolStats stats;
+};
 
-static struct {
-	int total;
-	int count;
-} pool_stats;
+static struct msg_pool msg_pool = {
+	.free = TAILQ_HEAD_INITIALIZER(msg_pool.free),
+};
 
 #ifdef DEBUG_POOL
-static void pool_debug(const char *str, void *addr)
+static void pool_debug(struct msg_pool *pool, const char *str, void *addr)
 {
-	fprintf(stderr, "*** %p %10s total %d count %d used %d\n",
-		addr, str, pool_stats.total, pool_stats.count,
-		pool_stats.total - pool_stats.count);
+	fprintf(stderr, "*** %p %10s total %" PRIu64 " used %" PRIu64 "\n",
+		addr, str, pool->stats.allocated, pool->stats.in_use);
 }
 #else
-static void pool_debug(const char *str, void *addr)
+static void pool_debug(struct msg_pool *pool, const char *str, void *addr)
 {
 }
 #endif
 
+static int pool_owns(struct msg_pool *pool, struct ptp_message *m)
+{
+	struct message_storage *s = container_of(m, struct message_storage, msg);
+
+	return pool->slab && s >= pool->slab && s < pool->slab + pool->capacity;
+}
+
+static struct ptp_message *pool_get(struct msg_pool *pool)
+{
+	struct ptp_message *m = TAILQ_FIRST(&pool->free);
+	struct message_storage *s;
+
+	if (m) {
+		TAILQ_REMOVE(&pool->free, m, list);
+		pool_debug(pool, "dequeue", m);
+	} else {
+		s = malloc(sizeof(*s));
+		if (!s) {
+			pool->stats.alloc_failures++;
+			return NULL;
+		}
+		m = &s->msg;
+		pool->stats.allocated++;
+		pool->stats.heap_allocations++;
+		pool_debug(pool, "allocate", m);
+	}
+	pool->stats.in_use++;
+	if (pool->stats.in_use > pool->stats.max_in_use) {
+		pool->stats.max_in_use = pool->stats.in_use;
+	}
+	return m;
+}
+
+static void pool_put(struct msg_pool *pool, struct ptp_message *m)
+{
+	pool->stats.in_use--;
+	if (pool->slab && !pool_owns(pool, m)) {
+		pool->stats.allocated--;
+		pool_debug(pool, "free", m);
+		free(container_of(m, struct message_storage, msg));
+		return;
+	}
+	pool_debug(pool, "recycle", m);
+	TAILQ_INSERT_HEAD(&pool->free, m, list);
+}
+
+/* Clears everything but the message buffer. */
+static void msg_reset(struct ptp_message *m)
+{
+	size_t offset = offsetof(struct ptp_message, tail_room);
+
+	memset((unsigned char *) m + offset, 0, sizeof(*m) - offset);
+	m->refcnt = 1;
+	TAILQ_INIT(&m->tlv_list);
+}
+
 static void announce_pre_send(struct announce_msg *m)
 {
 	m->currentUtcOffset = htons(m->currentUtcOffset);
@@ -223,6 +296,53 @@ static int suffix_post_recv(struct ptp_message *msg, int len)
 	return suffix_len;
 }
 
+/*
+ * Checks the framing of the TLVs in network byte order without
+ * modifying them.  Returns the length of the suffix, or -EBADMSG.
+ * Sets 'found' when a TLV of the given type is present.
+ */
+static int suffix_scan(uint8_t *ptr, int len, int type, int *found)
+{
+	int suffix_len = 0, tlv_len;
+	struct TLV *tlv;
+
+	if (!ptr)
+		return 0;
+
+	while (len >= sizeof(struct TLV)) {
+		tlv = (struct TLV *) ptr;
+		tlv_len = ntohs(tlv->length);
+		if (tlv_len % 2)
+			return -EBADMSG;
+		if (ntohs(tlv->type) == type)
+			*found = 1;
+		suffix_len += sizeof(struct TLV);
+		len -= sizeof(struct TLV);
+		ptr += sizeof(struct TLV);
+		if (tlv_len > len)
+			return -EBADMSG;
+		suffix_len += tlv_len;
+		len -= tlv_len;
+		ptr += tlv_len;
+	}
+	return suffix_len;
+}
+
+/*
+ * The TLVs of these messages are consulted by few code paths, if at
+ * all, so their conversion may be left to msg_tlv_unpack().
+ */
+static int suffix_lazy(int type)
+{
+	switch (type) {
+	case SIGNALING:
+	case MANAGEMENT:
+		return 0;
+	default:
+		return lazy_tlv_parse;
+	}
+}
+
 static void suffix_pre_send(struct ptp_message *msg)
 {
 	struct tlv_extra *extra;
@@ -257,27 +377,23 @@ static void timestamp_pre_send(struct Timestamp *ts)
 
 struct ptp_message *msg_allocate(void)
 {
-	struct message_storage *s;
-	struct ptp_message *m = TAILQ_FIRST(&msg_pool);
+	struct ptp_message *m = pool_get(&msg_pool);
 
 	if (m) {
-		TAILQ_REMOVE(&msg_pool, m, list);
-		pool_stats.count--;
-		pool_debug("dequeue", m);
-	} else {
-		s = malloc(sizeof(*s));
-		if (s) {
-			m = &s->msg;
-			pool_stats.total++;
-			pool_debug("allocate", m);
-		}
+		memset(m, 0, sizeof(m->data));
+		msg_reset(m);
 	}
+	return m;
+}
+
+struct ptp_message *msg_allocate_recv(void)
+{
+	struct ptp_message *m = pool_get(&msg_pool);
+
 	if (m) {
-		memset(m, 0, sizeof(*m));
-		m->refcnt = 1;
-		TAILQ_INIT(&m->tlv_list);
+		memset(&m->header, 0, sizeof(m->header));
+		msg_reset(m);
 	}
-
 	return m;
 }
 
@@ -288,11 +404,47 @@ void msg_cleanup(void)
 
 	tlv_extra_cleanup();
 
-	while ((m = TAILQ_FIRST(&msg_pool)) != NULL) {
-		TAILQ_REMOVE(&msg_pool, m, list);
+	while ((m = TAILQ_FIRST(&msg_pool.free)) != NULL) {
+		TAILQ_REMOVE(&msg_pool.free, m, list);
+		if (pool_owns(&msg_pool, m)) {
+			continue;
+		}
 		s = container_of(m, struct message_storage, msg);
 		free(s);
 	}
+	/* Messages still in use may point into the slab. */
+	if (msg_pool.slab && !msg_pool.stats.in_use) {
+		free(msg_pool.slab);
+		msg_pool.slab = NULL;
+		msg_pool.capacity = 0;
+		memset(&msg_pool.stats, 0, sizeof(msg_pool.stats));
+	}
+}
+
+int msg_pool_init(int capacity)
+{
+	struct msg_pool *pool = &msg_pool;
+	int i;
+
+	if (pool->slab || capacity <= 0) {
+		return pool->slab ? -EBUSY : 0;
+	}
+	pool->slab = calloc(capacity, sizeof(*pool->slab));
+	if (!pool->slab) {
+		return -ENOMEM;
+	}
+	pool->capacity = capacity;
+	pool->stats.capacity = capacity;
+	pool->stats.allocated += capacity;
+	for (i = 0; i < capacity; i++) {
+		TAILQ_INSERT_TAIL(&pool->free, &pool->slab[i].msg, list);
+	}
+	return 0;
+}
+
+void msg_pool_stats(struct MessagePoolStats *stats)
+{
+	*stats = msg_pool.stats;
 }
 
 struct ptp_message *msg_duplicate(struct ptp_message *msg, int cnt)
@@ -300,7 +452,7 @@ struct ptp_message *msg_duplicate(struct ptp_message *msg, int cnt)
 	struct ptp_message *dup;
 	int err;
 
-	dup = msg_allocate();
+	dup = msg_allocate_recv();
 	if (!dup) {
 		return NULL;
 	}
@@ -331,6 +483,19 @@ struct ptp_message *msg_duplicate(struct ptp_message *msg, int cnt)
 	return dup;
 }
 
+struct ptp_message *msg_from_template(struct ptp_message *tmpl)
+{
+	struct ptp_message *m;
+
+	m = msg_allocate();
+	if (!m) {
+		return NULL;
+	}
+	memcpy(&m->header, &tmpl->header, ntohs(tmpl->header.messageLength));
+	m->hwts.type = tmpl->hwts.type;
+	return m;
+}
+
 void msg_get(struct ptp_message *m)
 {
 	m->refcnt++;
@@ -338,11 +503,22 @@ void msg_get(struct ptp_message *m)
 
 int msg_post_recv(struct ptp_message *m, int cnt)
 {
-	int err, pdulen, suffix_len, type;
+	int err, found, pad, pdulen, suffix_len, type;
 
 	if (cnt < sizeof(struct ptp_header))
 		return -EBADMSG;
 
+	/*
+	 * A message from msg_allocate_recv() holds stale data after the
+	 * received bytes. End the suffix with an empty TLV header, as if
+	 * the buffer had been cleared.
+	 */
+	pad = sizeof(m->data) - cnt;
+	if (pad > (int) sizeof(struct TLV))
+		pad = sizeof(struct TLV);
+	if (pad > 0)
+		memset(m->data.buffer + cnt, 0, pad);
+
 	err = hdr_post_recv(&m->header);
 	if (err)
 		return err;
@@ -423,7 +599,14 @@ int msg_post_recv(struct ptp_message *m, int cnt)
 		break;
 	}
 
-	suffix_len = suffix_post_recv(m, cnt - pdulen);
+	if (suffix_lazy(type)) {
+		suffix_len = suffix_scan(msg_suffix(m), cnt - pdulen, -1, &found);
+		if (suffix_len > 0) {
+			m->tlv_pending = suffix_len;
+		}
+	} else {
+		suffix_len = suffix_post_recv(m, cnt - pdulen);
+	}
 	if (suffix_len < 0) {
 		return suffix_len;
 	}
@@ -480,13 +663,23 @@ int msg_pre_send(struct ptp_message *m)
 		return -1;
 	}
 	suffix_pre_send(m);
+	/* Unconverted TLVs are still in network byte order. */
+	m->tlv_pending = 0;
 	return 0;
 }
 
+void msg_timestamp_pre_send(struct Timestamp *ts)
+{
+	timestamp_pre_send(ts);
+}
+
 struct tlv_extra *msg_tlv_append(struct ptp_message *msg, int length)
 {
 	struct tlv_extra *extra;
 
+	if (msg_tlv_unpack(msg, TLV_ANY)) {
+		return NULL;
+	}
 	extra = msg_tlv_prepare(msg, length);
 	if (extra) {
 		msg->header.messageLength += length;
@@ -500,11 +693,31 @@ void msg_tlv_attach(struct ptp_message *msg, struct tlv_extra *extra)
 	TAILQ_INSERT_TAIL(&msg->tlv_list, extra, list);
 }
 
+int msg_tlv_unpack(struct ptp_message *msg, int type)
+{
+	int err, found = 0, len = msg->tlv_pending;
+
+	if (!len) {
+		return 0;
+	}
+	if (type != TLV_ANY) {
+		suffix_scan(msg_suffix(msg), len, type, &found);
+		if (!found) {
+			return 0;
+		}
+	}
+	msg->tlv_pending = 0;
+	err = suffix_post_recv(msg, len);
+	return err < 0 ? err : 0;
+}
+
 int msg_tlv_count(struct ptp_message *msg)
 {
 	int count = 0;
 	struct tlv_extra *extra;
 
+	msg_tlv_unpack(msg, TLV_ANY);
+
 	for (extra = TAILQ_FIRST(&msg->tlv_list);
 			extra != NULL;
 			extra = TAILQ_NEXT(extra, list))
@@ -580,10 +793,8 @@ void msg_put(struct ptp_message *m)
 	if (m->refcnt) {
 		return;
 	}
-	pool_stats.count++;
-	pool_debug("recycle", m);
 	msg_tlv_recycle(m);
-	TAILQ_INSERT_HEAD(&msg_pool, m, list);
+	pool_put(&msg_pool, m);
 }
 
 int msg_sots_missing(struct ptp_message *m)
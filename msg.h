@@ -84,6 +84,7 @@ struct hw_timestamp {
 	enum timestamp_type type;
 	tmv_t ts;
 	tmv_t sw;
+	uint32_t key; /* identifies an outstanding transmit time stamp */
 };
 
 struct ptp_header {
@@ -237,6 +238,11 @@ struct ptp_message {
 	 * pointers to the appended TLVs.
 	 */
 	TAILQ_HEAD(tlv_list, tlv_extra) tlv_list;
+	/**
+	 * Length of the received TLVs not yet converted and added to
+	 * the list, see msg_tlv_unpack().
+	 */
+	int tlv_pending;
 };
 
 /**
@@ -309,6 +315,26 @@ struct tlv_extra *msg_tlv_append(struct ptp_message *msg, int length);
  */
 void msg_tlv_attach(struct ptp_message *msg, struct tlv_extra *extra);
 
+/**
+ * Wildcard TLV type for msg_tlv_unpack().
+ */
+#define TLV_ANY -1
+
+/**
+ * Convert the TLVs of a received message and place them into the
+ * message's list of TLVs.  With lazy_tlv_parse, msg_post_recv() only
+ * checks the framing of the TLVs of messages other than signaling and
+ * management, and code looking at the list must call this first.
+ *
+ * @param msg   A received message.
+ * @param type  Only convert the TLVs if one of them has this type,
+ *              or TLV_ANY to convert them unconditionally.
+ * @return      Zero on success, or a negative error code if one of the
+ *              TLVs is malformed, in which case the message should
+ *              be dropped.
+ */
+int msg_tlv_unpack(struct ptp_message *msg, int type);
+
 /*
  * Return the number of TLVs attached to a message.
  * @param msg  A message obtained using @ref msg_allocate().
@@ -348,11 +374,37 @@ static inline int msg_type(const struct ptp_message *m)
  */
 struct ptp_message *msg_allocate(void);
 
+/**
+ * Allocate a new message instance to receive into.
+ *
+ * Only the header and the book keeping fields are cleared, since the
+ * caller overwrites the message buffer, for example by transport_recv().
+ * msg_post_recv() then clears one TLV header after the received data.
+ *
+ * @return Pointer to a message on success, NULL otherwise.
+ */
+struct ptp_message *msg_allocate_recv(void);
+
 /**
  * Release all of the memory in the message cache.
  */
 void msg_cleanup(void);
 
+/**
+ * Preallocate the message cache.  Beyond this capacity, messages are
+ * allocated from the heap and freed again once released.
+ * @param capacity  The number of messages to allocate up front.  With
+ *                  zero, the cache grows as needed and never shrinks.
+ * @return          Zero on success, negative error code otherwise.
+ */
+int msg_pool_init(int capacity);
+
+/**
+ * Obtain the usage statistics of the message cache.
+ * @param stats  Returns the statistics.
+ */
+void msg_pool_stats(struct MessagePoolStats *stats);
+
 /**
  * Duplicate a message instance.
  *
@@ -373,6 +425,19 @@ void msg_cleanup(void);
  */
 struct ptp_message *msg_duplicate(struct ptp_message *msg, int cnt);
 
+/**
+ * Allocate a new message as a copy of a template message. Only the
+ * wire image of the template is copied, together with the time stamp
+ * type.
+ *
+ * @param tmpl A message that has been passed to @ref msg_pre_send().
+ *
+ * @return     Pointer to a message on success, NULL otherwise.
+ *             The returned message is in network byte order, ready to
+ *             be sent without calling @ref msg_pre_send().
+ */
+struct ptp_message *msg_from_template(struct ptp_message *tmpl);
+
 /**
  * Obtain a reference to a message, increasing its reference count by one.
  * @param m A message obtained using @ref msg_allocate().
@@ -394,6 +459,13 @@ int msg_post_recv(struct ptp_message *m, int cnt);
  */
 int msg_pre_send(struct ptp_message *m);
 
+/**
+ * Convert a time stamp field to network byte order. Used to update
+ * messages that have already been passed to @ref msg_pre_send().
+ * @param ts  The time stamp field in host byte order.
+ */
+void msg_timestamp_pre_send(struct Timestamp *ts);
+
 /**
  * Print messages for debugging purposes.
  * @param type  Value of the messageType field as returned by @ref msg_type().
@@ -451,6 +523,11 @@ extern uint8_t ptp_hdr_ver;
  */
 extern int assume_two_step;
 
+/**
+ * Defer the conversion of received TLVs, see msg_tlv_unpack().
+ */
+extern int lazy_tlv_parse;
+
 /**
  * Test whether a message is one-step message.
  * @param m  Message to test.
@@ -22,15 +22,22 @@
 #include <float.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <math.h>
 #include <net/if.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/queue.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -68,12 +75,36 @@
 
 #define MAX_DOMAINS 16
 
+#define SERVO_STATE_PERIOD 60 /* seconds between writes of the state file */
+
+#define N_LOOP_EVENTS 16
+
+#define MAX_SRC_DRIFT 1e-3 /* larger changes of the source offset are steps */
+
+struct clock;
+struct domain;
+
+/* Identifies a descriptor of the main loop registered with epoll. */
+struct loop_source {
+	enum {
+		LOOP_PMC,	/* notifications and replies from ptp4l */
+		LOOP_TICK,	/* renewal of the ptp4l subscription */
+		LOOP_CLOCK,	/* update of a destination clock */
+		LOOP_THREAD,	/* failure of an update thread */
+	} type;
+	struct domain *domain;
+	struct clock *clock;
+};
+
 struct clock {
 	LIST_ENTRY(clock) list;
 	LIST_ENTRY(clock) dst_list;
 	clockid_t clkid;
 	int phc_index;
 	int sysoff_method;
+	struct sysoff_tuner *sysoff_tuner;
+	/* tuner of the last measurement, reported in the summary */
+	struct sysoff_tuner *sysoff_used;
 	int is_utc;
 	int dest_only;
 	int state;
@@ -83,6 +114,20 @@ struct clock {
 	int utc_offset_set;
 	struct servo *servo;
 	enum servo_state servo_state;
+	double locked_freq; /* frequency estimate of the locked servo */
+	enum servo_state locked_state;
+	time_t locked_time; /* zero until the servo has locked */
+	time_t state_saved;
+	double interval; /* seconds between updates as a destination */
+	int timer_fd;
+	int due;
+	struct loop_source timer_src;
+	/* optional update thread */
+	int update_thread;
+	int thread_cpu;
+	int stop_fd;
+	int fail_fd;
+	pthread_t thread;
 	char *device;
 	const char *source_label;
 	struct stats *offset_stats;
@@ -104,6 +149,14 @@ struct domain {
 	enum servo_type servo_type;
 	int phc_readings;
 	double phc_interval;
+	int shared_src_sample;
+	/* source clock sample of the current cycle, see src_sample() */
+	int src_sampled;
+	int64_t src_offset;
+	uint64_t src_ts;
+	int64_t src_delay;
+	/* change of the source offset per ns of system time */
+	double src_drift;
 	int forced_sync_offset;
 	int kernel_leap;
 	int state_changed;
@@ -117,18 +170,119 @@ struct domain {
 	struct clock *src_clock;
 	struct domain *src_domain;
 	int src_priority;
+	int tick_fd;
+	struct loop_source tick_src;
+	struct loop_source pmc_src;
 };
 
 static struct config *phc2sys_config;
 
+/*
+ * Protects the state shared with the update threads, i.e. the domains,
+ * their lists of clocks and the pmc agents.  The main loop holds it for
+ * writing while it processes the messages from ptp4l and reconfigures
+ * the domains, the update threads hold it for reading while they
+ * measure and adjust their clocks.
+ */
+static pthread_rwlock_t loop_lock = PTHREAD_RWLOCK_INITIALIZER;
+
 static int clock_handle_leap(struct domain *domain,
 			     struct clock *clock,
 			     int64_t offset, uint64_t ts);
 
+static int servo_state_path(struct clock *clock, char *buf, size_t len)
+{
+	const char *dir, *name;
+
+	dir = config_get_string(phc2sys_config, NULL, "servo_state_dir");
+	if (!dir || !dir[0])
+		return -1;
+
+	if (clock->clkid == CLOCK_REALTIME) {
+		snprintf(buf, len, "%s/CLOCK_REALTIME", dir);
+	} else if (clock->phc_index >= 0) {
+		snprintf(buf, len, "%s/ptp%d", dir, clock->phc_index);
+	} else if (clock->device) {
+		name = strrchr(clock->device, '/');
+		name = name ? name + 1 : clock->device;
+		snprintf(buf, len, "%s/%s", dir, name);
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Write the last locked frequency, the servo state and the time of the
+ * lock, so that a restarted phc2sys can continue from that frequency.
+ */
+static void servo_state_save(struct clock *clock)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 4];
+	FILE *fp;
+
+	if (!clock->locked_time || servo_state_path(clock, path, sizeof(path)))
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		pr_err("failed to open %s: %m", tmp);
+		return;
+	}
+	fprintf(fp, "%.3f %d %lld\n", clock->locked_freq, clock->locked_state,
+		(long long) clock->locked_time);
+	if (fclose(fp) || rename(tmp, path)) {
+		pr_err("failed to write %s: %m", path);
+		unlink(tmp);
+		return;
+	}
+	clock->state_saved = clock->locked_time;
+}
+
+static int servo_state_load(struct clock *clock, int max_ppb, double *freq)
+{
+	int max_age, state;
+	char path[PATH_MAX];
+	struct timespec now;
+	long long saved;
+	FILE *fp;
+	int cnt;
+
+	if (servo_state_path(clock, path, sizeof(path)))
+		return -1;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		if (errno != ENOENT)
+			pr_err("failed to open %s: %m", path);
+		return -1;
+	}
+	cnt = fscanf(fp, "%lf %d %lld", freq, &state, &saved);
+	fclose(fp);
+	if (cnt != 3) {
+		pr_err("invalid servo state in %s", path);
+		return -1;
+	}
+
+	max_age = config_get_int(phc2sys_config, NULL, "servo_state_max_age");
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (saved > now.tv_sec || now.tv_sec - saved > max_age) {
+		pr_info("%s: servo state is too old", path);
+		return -1;
+	}
+	if ((state != SERVO_LOCKED && state != SERVO_LOCKED_STABLE) ||
+	    fabs(*freq) > max_ppb) {
+		pr_info("%s: ignoring servo state", path);
+		return -1;
+	}
+	return 0;
+}
+
 static struct servo *servo_add(struct domain *domain,
 			       struct clock *clock)
 {
-	double ppb;
+	double ppb, freq;
 	int max_ppb;
 	struct servo *servo;
 
@@ -145,6 +299,13 @@ static struct servo *servo_add(struct domain *domain,
 		}
 	}
 
+	if (!domain->free_running &&
+	    !servo_state_load(clock, max_ppb, &freq)) {
+		pr_info("%s: restoring frequency %+.0f", clock->device, freq);
+		ppb = -freq;
+		clockadj_set_freq(clock->clkid, ppb);
+	}
+
 	servo = servo_create(phc2sys_config, domain->servo_type,
 			     -ppb, max_ppb, 0);
 	if (!servo) {
@@ -152,7 +313,7 @@ static struct servo *servo_add(struct domain *domain,
 		return NULL;
 	}
 
-	servo_sync_interval(servo, domain->phc_interval);
+	servo_sync_interval(servo, clock->interval);
 
 	return servo;
 }
@@ -163,6 +324,8 @@ static struct clock *clock_add(struct domain *domain, const char *device,
 	struct clock *c;
 	clockid_t clkid = CLOCK_INVALID;
 	char phc_device[19];
+	int interval;
+	double rate;
 
 	if (device) {
 		if (phc_index >= 0) {
@@ -185,6 +348,17 @@ static struct clock *clock_add(struct domain *domain, const char *device,
 	c->phc_index = phc_index;
 	c->servo_state = SERVO_UNLOCKED;
 	c->device = device ? strdup(device) : NULL;
+	c->timer_fd = -1;
+	c->stop_fd = -1;
+	c->fail_fd = -1;
+	c->update_thread = config_get_int(phc2sys_config, device,
+					  "update_thread");
+	c->thread_cpu = config_get_int(phc2sys_config, device,
+				       "update_thread_cpu");
+
+	/* The update rate may be set in a section named after the clock. */
+	rate = config_get_double(phc2sys_config, device, "update_rate");
+	c->interval = rate > 0.0 ? 1.0 / rate : domain->phc_interval;
 
 	if (c->clkid == CLOCK_REALTIME) {
 		c->source_label = "sys";
@@ -216,6 +390,17 @@ static struct clock *clock_add(struct domain *domain, const char *device,
 		c->sysoff_method = sysoff_probe(CLOCKID_TO_FD(clkid),
 						domain->phc_readings);
 
+	interval = config_get_int(phc2sys_config, NULL,
+				  "sysoff_reprobe_interval");
+	if (interval && c->sysoff_method >= 0 && clkid != CLOCK_REALTIME) {
+		c->sysoff_tuner = sysoff_tuner_create(CLOCKID_TO_FD(clkid),
+						      c->device, interval);
+		if (!c->sysoff_tuner)
+			pr_warning("%s: no adaptive sysoff, using %s",
+				   c->device,
+				   sysoff_method_str(c->sysoff_method));
+	}
+
 	LIST_INSERT_HEAD(&domain->clocks, c, list);
 	return c;
 }
@@ -226,11 +411,15 @@ static void clock_cleanup(struct domain *domain)
 
 	LIST_FOREACH_SAFE(c, &domain->clocks, list, tmp) {
 		if (c->servo) {
+			servo_state_save(c);
 			servo_destroy(c->servo);
 		}
 		if (c->sanity_check) {
 			clockcheck_destroy(c->sanity_check);
 		}
+		if (c->sysoff_tuner) {
+			sysoff_tuner_destroy(c->sysoff_tuner);
+		}
 		if (c->delay_stats) {
 			stats_destroy(c->delay_stats);
 		}
@@ -537,6 +726,8 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 			       int64_t offset, double freq, int64_t delay)
 {
 	struct stats_result offset_stats, freq_stats, delay_stats;
+	struct sysoff_stats sysoff_stats;
+	char sysoff[80] = "";
 
 	stats_add_value(clock->offset_stats, offset);
 	stats_add_value(clock->freq_stats, freq);
@@ -549,22 +740,39 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 	stats_get_result(clock->offset_stats, &offset_stats);
 	stats_get_result(clock->freq_stats, &freq_stats);
 
+	if (clock->sysoff_used) {
+		sysoff_tuner_get_stats(clock->sysoff_used, &sysoff_stats);
+		snprintf(sysoff, sizeof(sysoff),
+			 " sysoff %s/%d delay %5.0f +/- %3.0f",
+			 sysoff_method_str(sysoff_stats.method),
+			 sysoff_stats.n_samples, sysoff_stats.delay_mean,
+			 sysoff_stats.delay_stddev);
+	}
+
 	if (!stats_get_result(clock->delay_stats, &delay_stats)) {
 		pr_info("%s "
 			"rms %4.0f max %4.0f "
 			"freq %+6.0f +/- %3.0f "
-			"delay %5.0f +/- %3.0f",
+			"delay %5.0f +/- %3.0f "
+			"p50 %4.0f p99 %4.0f p99.9 %4.0f "
+			"delay p50 %5.0f p99 %5.0f p99.9 %5.0f%s",
 			clock->device,
 			offset_stats.rms, offset_stats.max_abs,
 			freq_stats.mean, freq_stats.stddev,
-			delay_stats.mean, delay_stats.stddev);
+			delay_stats.mean, delay_stats.stddev,
+			offset_stats.p50, offset_stats.p99, offset_stats.p999,
+			delay_stats.p50, delay_stats.p99, delay_stats.p999,
+			sysoff);
 	} else {
 		pr_info("%s "
 			"rms %4.0f max %4.0f "
-			"freq %+6.0f +/- %3.0f",
+			"freq %+6.0f +/- %3.0f "
+			"p50 %4.0f p99 %4.0f p99.9 %4.0f%s",
 			clock->device,
 			offset_stats.rms, offset_stats.max_abs,
-			freq_stats.mean, freq_stats.stddev);
+			freq_stats.mean, freq_stats.stddev,
+			offset_stats.p50, offset_stats.p99, offset_stats.p999,
+			sysoff);
 	}
 
 	stats_reset(clock->offset_stats);
@@ -572,6 +780,18 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 	stats_reset(clock->delay_stats);
 }
 
+static void clock_locked(struct clock *clock, enum servo_state state)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	clock->locked_freq = servo_frequency(clock->servo);
+	clock->locked_state = state;
+	clock->locked_time = now.tv_sec;
+	if (now.tv_sec - clock->state_saved >= SERVO_STATE_PERIOD)
+		servo_state_save(clock);
+}
+
 static void update_clock(struct domain *domain, struct clock *clock,
 			 int64_t offset, uint64_t ts, int64_t delay)
 {
@@ -595,6 +815,7 @@ static void update_clock(struct domain *domain, struct clock *clock,
 	if (clock->sanity_check && clockcheck_sample(clock->sanity_check, ts))
 		servo_reset(clock->servo);
 
+	servo_trace_delay(clock->servo, delay);
 	ppb = servo_sample(clock->servo, offset, ts, 1.0, &state);
 	clock->servo_state = state;
 
@@ -607,6 +828,11 @@ static void update_clock(struct domain *domain, struct clock *clock,
 		}
 		if (clock->sanity_check)
 			clockcheck_step(clock->sanity_check, -offset);
+		/* The shared source sample is relative to the system clock. */
+		if (clock->clkid == CLOCK_REALTIME && !clock->update_thread) {
+			domain->src_sampled = 0;
+			domain->src_ts = 0;
+		}
 		/* Fall through. */
 	case SERVO_LOCKED:
 	case SERVO_LOCKED_STABLE:
@@ -620,6 +846,8 @@ static void update_clock(struct domain *domain, struct clock *clock,
 			sysclk_set_sync();
 		if (clock->sanity_check)
 			clockcheck_set_freq(clock->sanity_check, -ppb);
+		if (state != SERVO_JUMP)
+			clock_locked(clock, state);
 		break;
 	}
 
@@ -753,119 +981,525 @@ static int update_needed(struct clock *c)
 	return 0;
 }
 
-static int update_domain_clocks(struct domain *domain)
+static int clock_sysoff_measure(struct domain *domain, struct clock *clock,
+				int64_t *offset, uint64_t *ts, int64_t *delay)
+{
+	if (clock->sysoff_tuner)
+		return sysoff_tuner_measure(clock->sysoff_tuner,
+					    offset, ts, delay);
+
+	return sysoff_measure(CLOCKID_TO_FD(clock->clkid),
+			      clock->sysoff_method, domain->phc_readings,
+			      offset, ts, delay);
+}
+
+/*
+ * Measures the source clock against the system clock. The main loop
+ * samples the source once per cycle and shares the sample among the
+ * destinations it updates, the update threads take their own sample.
+ * The drift of the offset is estimated from the samples of the last two
+ * cycles, so that the shared sample can be carried forward in time.
+ */
+static int src_sample(struct domain *domain, struct clock *clock,
+		      int64_t *offset, uint64_t *ts, int64_t *delay,
+		      double *drift)
+{
+	struct clock *src = domain->src_clock;
+	int64_t src_offset, src_delay;
+	uint64_t src_ts;
+	int err;
+
+	if (clock->update_thread) {
+		*drift = 0.0;
+		return clock_sysoff_measure(domain, src, offset, ts, delay);
+	}
+
+	if (!domain->src_sampled) {
+		err = clock_sysoff_measure(domain, src, &src_offset, &src_ts,
+					   &src_delay);
+		if (err)
+			return err;
+		domain->src_drift = 0.0;
+		if (domain->src_ts && src_ts > domain->src_ts)
+			domain->src_drift = (double)(src_offset -
+						     domain->src_offset) /
+				(src_ts - domain->src_ts);
+		if (fabs(domain->src_drift) > MAX_SRC_DRIFT)
+			domain->src_drift = 0.0;
+		domain->src_offset = src_offset;
+		domain->src_ts = src_ts;
+		domain->src_delay = src_delay;
+		domain->src_sampled = 1;
+	}
+	*offset = domain->src_offset;
+	*ts = domain->src_ts;
+	*delay = domain->src_delay;
+	*drift = domain->src_drift;
+	return 0;
+}
+
+/*
+ * Derives the offset between two PHCs from their offsets to the system
+ * clock, so that the source is not read again for each destination.
+ */
+static int transitive_measure(struct domain *domain, struct clock *clock,
+			      int64_t *offset, uint64_t *ts, int64_t *delay)
+{
+	int64_t src_offset, src_delay, dst_offset, dst_delay;
+	uint64_t src_ts, dst_ts;
+	double drift;
+	int err;
+
+	err = src_sample(domain, clock, &src_offset, &src_ts, &src_delay,
+			 &drift);
+	if (err)
+		return err;
+
+	if (clock->clkid == CLOCK_REALTIME) {
+		*offset = src_offset;
+		*ts = src_ts;
+		*delay = src_delay;
+		clock->sysoff_used = domain->src_clock->sysoff_tuner;
+		return 0;
+	}
+
+	err = clock_sysoff_measure(domain, clock,
+				   &dst_offset, &dst_ts, &dst_delay);
+	clock->sysoff_used = clock->sysoff_tuner;
+	if (err)
+		return err;
+
+	/*
+	 * Both offsets are the system time minus the PHC time. Move the
+	 * source offset to the time of the destination sample.
+	 */
+	src_offset += llround(drift * (int64_t)(dst_ts - src_ts));
+	*offset = src_offset - dst_offset;
+	*ts = dst_ts - dst_offset;
+	*delay = src_delay + dst_delay;
+	return 0;
+}
+
+static int update_domain_clock(struct domain *domain, struct clock *clock)
 {
 	int64_t offset, delay;
-	struct clock *clock;
 	uint64_t ts;
 	int err;
 
-	LIST_FOREACH(clock, &domain->dst_clocks, dst_list) {
-		if (!update_needed(clock))
-			continue;
+	if (!update_needed(clock))
+		return 0;
+
+	/* don't try to synchronize the clock to itself */
+	if (clock->clkid == domain->src_clock->clkid ||
+	    (clock->phc_index >= 0 &&
+	     clock->phc_index == domain->src_clock->phc_index) ||
+	    !strcmp(clock->device, domain->src_clock->device))
+		return 0;
+
+	if (domain->shared_src_sample &&
+	    domain->src_clock->sysoff_method >= 0 &&
+	    (clock->clkid == CLOCK_REALTIME || clock->sysoff_method >= 0)) {
+		/* use sysoff of both clocks, sharing the source sample */
+		err = transitive_measure(domain, clock, &offset, &ts, &delay);
+	} else if (clock->clkid == CLOCK_REALTIME &&
+		   domain->src_clock->sysoff_method >= 0) {
+		/* use sysoff */
+		err = clock_sysoff_measure(domain, domain->src_clock,
+					   &offset, &ts, &delay);
+		clock->sysoff_used = domain->src_clock->sysoff_tuner;
+	} else if (domain->src_clock->clkid == CLOCK_REALTIME &&
+		   clock->sysoff_method >= 0) {
+		/* use reversed sysoff */
+		err = clock_sysoff_measure(domain, clock, &offset, &ts, &delay);
+		clock->sysoff_used = clock->sysoff_tuner;
+		if (!err) {
+			offset = -offset;
+			ts += offset;
+		}
+	} else {
+		/* use phc */
+		clock->sysoff_used = NULL;
+		err = clockadj_compare(domain->src_clock->clkid,
+				       clock->clkid,
+				       domain->phc_readings,
+				       &offset, &ts, &delay);
+	}
+	if (err == -EBUSY)
+		return 0;
+	if (err)
+		return -1;
+	update_clock(domain, clock, offset, ts, delay);
+
+	return 0;
+}
+
+static int loop_add(int epfd, int fd, struct loop_source *src)
+{
+	struct epoll_event event;
+
+	event.events = EPOLLIN;
+	event.data.ptr = src;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event)) {
+		pr_err("failed to add a descriptor to epoll: %m");
+		return -1;
+	}
+	return 0;
+}
+
+/* Creates a periodic timer with expirations on an absolute time grid. */
+static int loop_timer(double interval)
+{
+	struct itimerspec tmo;
+	struct timespec now;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (fd < 0) {
+		pr_err("timerfd_create failed: %m");
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	tmo.it_interval.tv_sec = interval;
+	tmo.it_interval.tv_nsec = (interval - tmo.it_interval.tv_sec) * 1e9;
+	tmo.it_value.tv_sec = now.tv_sec + tmo.it_interval.tv_sec;
+	tmo.it_value.tv_nsec = now.tv_nsec + tmo.it_interval.tv_nsec;
+	if (tmo.it_value.tv_nsec >= NS_PER_SEC) {
+		tmo.it_value.tv_sec++;
+		tmo.it_value.tv_nsec -= NS_PER_SEC;
+	}
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &tmo, NULL)) {
+		pr_err("timerfd_settime failed: %m");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int loop_read_timer(int fd)
+{
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) < 0) {
+		pr_err("failed to read a timer: %m");
+		return -1;
+	}
+	return 0;
+}
+
+static int clock_is_dst(struct domain *domain, struct clock *clock)
+{
+	struct clock *c;
 
-		/* don't try to synchronize the clock to itself */
-		if (clock->clkid == domain->src_clock->clkid ||
-		    (clock->phc_index >= 0 &&
-		     clock->phc_index == domain->src_clock->phc_index) ||
-		    !strcmp(clock->device, domain->src_clock->device))
+	LIST_FOREACH(c, &domain->dst_clocks, dst_list) {
+		if (c == clock)
+			return 1;
+	}
+	return 0;
+}
+
+static void *clock_thread_run(void *arg)
+{
+	struct clock *clock = arg;
+	struct domain *domain = clock->timer_src.domain;
+	struct pollfd pfd[2];
+	uint64_t one = 1;
+	int err = 0;
+
+	pfd[0].fd = clock->timer_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = clock->stop_fd;
+	pfd[1].events = POLLIN;
+
+	while (!err) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_err("%s: update thread: poll failed: %m",
+			       clock->device);
+			err = -1;
+			break;
+		}
+		if (pfd[1].revents)
+			break;
+		if (!(pfd[0].revents & POLLIN))
 			continue;
+		if (loop_read_timer(clock->timer_fd)) {
+			err = -1;
+			break;
+		}
+		pthread_rwlock_rdlock(&loop_lock);
+		if (domain->src_clock && clock_is_dst(domain, clock))
+			err = update_domain_clock(domain, clock);
+		pthread_rwlock_unlock(&loop_lock);
+	}
+
+	/* Let the main loop terminate the program. */
+	if (err && write(clock->fail_fd, &one, sizeof(one)) != sizeof(one))
+		pr_err("%s: failed to report update failure: %m",
+		       clock->device);
+	return NULL;
+}
+
+static void clock_thread_close(struct clock *clock)
+{
+	if (clock->stop_fd >= 0)
+		close(clock->stop_fd);
+	if (clock->fail_fd >= 0)
+		close(clock->fail_fd);
+	clock->stop_fd = -1;
+	clock->fail_fd = -1;
+}
+
+static int clock_thread_start(int epfd, struct clock *clock)
+{
+	sigset_t mask, old_mask;
+	cpu_set_t cpus;
+	int err;
+
+	clock->stop_fd = eventfd(0, EFD_CLOEXEC);
+	clock->fail_fd = eventfd(0, EFD_CLOEXEC);
+	if (clock->stop_fd < 0 || clock->fail_fd < 0) {
+		pr_err("%s: failed to create update thread descriptors: %m",
+		       clock->device);
+		goto failed;
+	}
+	clock->timer_src.type = LOOP_THREAD;
+	if (loop_add(epfd, clock->fail_fd, &clock->timer_src))
+		goto failed;
+
+	/* Leave the termination signals to the main loop. */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGQUIT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	err = pthread_create(&clock->thread, NULL, clock_thread_run, clock);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	if (err) {
+		pr_err("failed to create update thread: %s", strerror(err));
+		goto failed;
+	}
+	if (clock->thread_cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(clock->thread_cpu, &cpus);
+		err = pthread_setaffinity_np(clock->thread, sizeof(cpus),
+					     &cpus);
+		if (err) {
+			pr_warning("%s: failed to pin update thread to cpu %d: %s",
+				   clock->device, clock->thread_cpu,
+				   strerror(err));
+		}
+	}
+	return 0;
+
+failed:
+	clock_thread_close(clock);
+	return -1;
+}
+
+static void clock_thread_stop(struct clock *clock)
+{
+	uint64_t one = 1;
+
+	if (clock->stop_fd < 0)
+		return;
+	if (write(clock->stop_fd, &one, sizeof(one)) != sizeof(one))
+		pr_err("%s: failed to stop update thread: %m", clock->device);
+	pthread_join(clock->thread, NULL);
+	clock_thread_close(clock);
+}
+
+static int loop_init(int epfd, struct domain *domains, int n_domains)
+{
+	struct domain *domain;
+	struct clock *clock;
+	int i, fd;
 
-		if (clock->clkid == CLOCK_REALTIME &&
-		    domain->src_clock->sysoff_method >= 0) {
-			/* use sysoff */
-			err = sysoff_measure(CLOCKID_TO_FD(domain->src_clock->clkid),
-					     domain->src_clock->sysoff_method,
-					     domain->phc_readings,
-					     &offset, &ts, &delay);
-		} else if (domain->src_clock->clkid == CLOCK_REALTIME &&
-			   clock->sysoff_method >= 0) {
-			/* use reversed sysoff */
-			err = sysoff_measure(CLOCKID_TO_FD(clock->clkid),
-					     clock->sysoff_method,
-					     domain->phc_readings,
-					     &offset, &ts, &delay);
-			if (!err) {
-				offset = -offset;
-				ts += offset;
+	for (i = 0; i < n_domains; i++) {
+		domain = &domains[i];
+		LIST_FOREACH(clock, &domain->clocks, list) {
+			clock->timer_src.type = LOOP_CLOCK;
+			clock->timer_src.domain = domain;
+			clock->timer_src.clock = clock;
+			clock->timer_fd = loop_timer(clock->interval);
+			if (clock->timer_fd < 0)
+				return -1;
+			if (clock->update_thread) {
+				if (clock_thread_start(epfd, clock))
+					return -1;
+			} else if (loop_add(epfd, clock->timer_fd,
+					    &clock->timer_src)) {
+				return -1;
 			}
-		} else {
-			/* use phc */
-			err = clockadj_compare(domain->src_clock->clkid,
-					       clock->clkid,
-					       domain->phc_readings,
-					       &offset, &ts, &delay);
 		}
-		if (err == -EBUSY)
+		fd = pmc_agent_get_fd(domain->agent);
+		if (fd < 0)
 			continue;
-		if (err)
+		domain->pmc_src.type = LOOP_PMC;
+		domain->pmc_src.domain = domain;
+		if (loop_add(epfd, fd, &domain->pmc_src))
+			return -1;
+		domain->tick_src.type = LOOP_TICK;
+		domain->tick_src.domain = domain;
+		domain->tick_fd = loop_timer(domain->phc_interval);
+		if (domain->tick_fd < 0 ||
+		    loop_add(epfd, domain->tick_fd, &domain->tick_src))
 			return -1;
-		update_clock(domain, clock, offset, ts, delay);
 	}
-
 	return 0;
 }
 
-static int do_loop(struct domain *domains, int n_domains)
+static void loop_cleanup(struct domain *domains, int n_domains)
 {
-	int i, state_changed, prev_sub;
-	struct timespec interval;
 	struct domain *domain;
+	struct clock *clock;
+	int i;
 
-	/* All domains have the same interval */
-	interval.tv_sec = domains[0].phc_interval;
-	interval.tv_nsec = (domains[0].phc_interval - interval.tv_sec) * 1e9;
-
-	while (is_running()) {
-		clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
+	for (i = 0; i < n_domains; i++) {
+		domain = &domains[i];
+		LIST_FOREACH(clock, &domain->clocks, list) {
+			clock_thread_stop(clock);
+			if (clock->timer_fd >= 0)
+				close(clock->timer_fd);
+			clock->timer_fd = -1;
+		}
+		if (domain->tick_fd >= 0)
+			close(domain->tick_fd);
+		domain->tick_fd = -1;
+	}
+}
 
-		state_changed = 0;
-		for (i = 0; i < n_domains; i++) {
-			domain = &domains[i];
-			if (pmc_agent_update(domain->agent) < 0) {
-				continue;
-			}
+/*
+ * Handles the ready descriptors of the main loop and reconfigures the
+ * domains after a port state change.  Marks the clocks due for update.
+ */
+static int loop_dispatch(struct domain *domains, int n_domains,
+			 struct epoll_event *ev, int cnt)
+{
+	int i, state_changed = 0, prev_sub;
+	struct loop_source *src;
+	struct domain *domain;
 
+	for (i = 0; i < cnt; i++) {
+		src = ev[i].data.ptr;
+		domain = src->domain;
+		switch (src->type) {
+		case LOOP_PMC:
+			pmc_agent_recv(domain->agent);
+			break;
+		case LOOP_TICK:
+			if (loop_read_timer(domain->tick_fd))
+				return -1;
+			if (pmc_agent_renew(domain->agent) < 0)
+				break;
 			prev_sub = domain->agent_subscribed;
 			domain->agent_subscribed =
 				pmc_agent_is_subscribed(domain->agent);
-			if (!domain->has_rt_clock && !domain->agent_subscribed) {
-				if (prev_sub) {
-					pr_err("Lost connection to ptp4l #%d", i + 1);
-					state_changed = 1;
-				}
-				continue;
-			}
-
-			if (domain->state_changed) {
+			if (!domain->has_rt_clock &&
+			    !domain->agent_subscribed && prev_sub) {
+				pr_err("Lost connection to ptp4l #%d",
+				       (int)(domain - domains) + 1);
 				state_changed = 1;
-
-				/* force getting offset, as it may have
-				 * changed after the port state change */
-				if (pmc_agent_query_utc_offset(domain->agent,
-							       1000)) {
-					pr_err("failed to get UTC offset");
-					continue;
-				}
 			}
+			break;
+		case LOOP_CLOCK:
+			if (loop_read_timer(src->clock->timer_fd))
+				return -1;
+			src->clock->due = 1;
+			break;
+		case LOOP_THREAD:
+			return -1;
 		}
+	}
+
+	for (i = 0; i < n_domains; i++) {
+		domain = &domains[i];
+		if (!domain->state_changed)
+			continue;
+		domain->agent_subscribed =
+			pmc_agent_is_subscribed(domain->agent);
+		if (!domain->has_rt_clock && !domain->agent_subscribed)
+			continue;
+
+		state_changed = 1;
 
-		if (state_changed) {
-			reconfigure(domains, n_domains);
-			state_changed = 0;
+		/* force getting offset, as it may have
+		 * changed after the port state change */
+		if (pmc_agent_query_utc_offset(domain->agent, 1000)) {
+			pr_err("failed to get UTC offset");
+			continue;
 		}
+	}
 
-		for (i = 0; i < n_domains; i++) {
-			domain = &domains[i];
+	if (state_changed)
+		reconfigure(domains, n_domains);
 
-			if (!domain->src_clock)
+	return 0;
+}
+
+/*
+ * Waits for the ptp4l notifications and for the timers of the clocks.
+ * Each destination clock is updated at its own rate, and ptp4l is only
+ * contacted when a message is pending or the subscription is due.
+ * Clocks with an update thread are measured and adjusted concurrently
+ * by their threads, the remaining clocks by this loop.
+ */
+static int do_loop(struct domain *domains, int n_domains)
+{
+	struct epoll_event ev[N_LOOP_EVENTS];
+	int i, cnt, res, err = -1, epfd;
+	struct domain *domain;
+	struct clock *clock;
+
+	for (i = 0; i < n_domains; i++) {
+		domains[i].tick_fd = -1;
+	}
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		pr_err("failed to create epoll instance: %m");
+		return -1;
+	}
+	if (loop_init(epfd, domains, n_domains))
+		goto out;
+
+	while (is_running()) {
+		cnt = epoll_wait(epfd, ev, N_LOOP_EVENTS, -1);
+		if (cnt < 0) {
+			if (errno == EINTR)
 				continue;
+			pr_err("epoll_wait failed: %m");
+			goto out;
+		}
 
-			if (update_domain_clocks(domain))
-				return -1;
+		pthread_rwlock_wrlock(&loop_lock);
+		res = loop_dispatch(domains, n_domains, ev, cnt);
+		pthread_rwlock_unlock(&loop_lock);
+		if (res)
+			goto out;
+
+		/* Only this thread modifies the domains, no lock needed. */
+		for (i = 0; i < n_domains; i++) {
+			domain = &domains[i];
+			domain->src_sampled = 0;
+
+			if (domain->src_clock) {
+				LIST_FOREACH(clock, &domain->dst_clocks,
+					     dst_list) {
+					if (clock->due &&
+					    update_domain_clock(domain, clock))
+						goto out;
+				}
+			}
+			LIST_FOREACH(clock, &domain->clocks, list) {
+				clock->due = 0;
+			}
 		}
 	}
-	return 0;
+	err = 0;
+out:
+	loop_cleanup(domains, n_domains);
+	close(epfd);
+	return err;
 }
 
 static int clock_compute_state(struct domain *domain,
@@ -1250,6 +1884,9 @@ int main(int argc, char *argv[])
 			} else if (!strcasecmp(optarg, "linreg")) {
 				config_set_int(cfg, "clock_servo",
 					       CLOCK_SERVO_LINREG);
+			} else if (!strcasecmp(optarg, "kalman")) {
+				config_set_int(cfg, "clock_servo",
+					       CLOCK_SERVO_KALMAN);
 			} else if (!strcasecmp(optarg, "ntpshm")) {
 				config_set_int(cfg, "clock_servo",
 					       CLOCK_SERVO_NTPSHM);
@@ -1433,6 +2070,8 @@ int main(int argc, char *argv[])
 	}
 	settings.kernel_leap = config_get_int(cfg, NULL, "kernel_leap");
 	settings.sanity_freq_limit = config_get_int(cfg, NULL, "sanity_freq_limit");
+	settings.shared_src_sample = config_get_int(cfg, NULL,
+						    "shared_src_sample");
 
 	if (autocfg) {
 		if (n_domains == 0)
@@ -177,6 +177,21 @@ static void pi_reset(struct servo *servo)
 	s->count = 0;
 }
 
+static void pi_seed(struct servo *servo, double fadj)
+{
+	struct pi_servo *s = container_of(servo, struct pi_servo, servo);
+
+	s->drift = fadj;
+	s->last_freq = fadj;
+}
+
+static double pi_frequency(struct servo *servo)
+{
+	struct pi_servo *s = container_of(servo, struct pi_servo, servo);
+
+	return s->drift;
+}
+
 struct servo *pi_servo_create(struct config *cfg, double fadj, int sw_ts)
 {
 	struct pi_servo *s;
@@ -189,6 +204,8 @@ struct servo *pi_servo_create(struct config *cfg, double fadj, int sw_ts)
 	s->servo.sample  = pi_sample;
 	s->servo.sync_interval = pi_sync_interval;
 	s->servo.reset   = pi_reset;
+	s->servo.frequency = pi_frequency;
+	s->servo.seed    = pi_seed;
 	s->drift         = fadj;
 	s->last_freq     = fadj;
 	s->kp            = 0.0;
@@ -89,6 +89,26 @@ static void pmc_show_rx_sync_timing(struct slave_rx_sync_timing_record *record,
 }
 
 
+static void pmc_show_histogram(const char *name, struct StatsHistogram *h,
+			       FILE *fp)
+{
+	int i;
+
+	fprintf(fp,
+		IFMT "%-6s count  %" PRIu64
+		IFMT "%-6s p50    %" PRId64
+		IFMT "%-6s p99    %" PRId64
+		IFMT "%-6s p99.9  %" PRId64
+		IFMT "%-6s max    %" PRId64,
+		name, h->count, name, h->p50, name, h->p99,
+		name, h->p999, name, h->max);
+	for (i = 0; i < STATS_HISTOGRAM_BINS; i++) {
+		if (h->bins[i])
+			fprintf(fp, IFMT "%-6s <2^%-3d %u", name, i,
+				h->bins[i]);
+	}
+}
+
 static void pmc_show_unicast_master_entry(struct unicast_master_entry *entry,
 				    FILE *fp)
 {
@@ -162,6 +182,8 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 	struct ieee_c37_238_settings_np *pwr;
 	struct unicast_master_table_np *umtn;
 	struct grandmaster_settings_np *gsn;
+	struct message_pool_stats_np *mpsp;
+	struct clock_stats_np *csnp;
 	struct port_service_stats_np *pssp;
 	struct mgmt_clock_description *cd;
 	struct management_tlv_datum *mtd;
@@ -447,6 +469,28 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 			gsn->time_flags & FREQ_TRACEABLE ? 1 : 0,
 			gsn->time_source);
 		break;
+	case MID_MESSAGE_POOL_STATS_NP:
+		mpsp = (struct message_pool_stats_np *) mgt->data;
+		fprintf(fp, "MESSAGE_POOL_STATS_NP "
+			IFMT "capacity          %" PRIu64
+			IFMT "allocated         %" PRIu64
+			IFMT "in_use            %" PRIu64
+			IFMT "max_in_use        %" PRIu64
+			IFMT "heap_allocations  %" PRIu64
+			IFMT "alloc_failures    %" PRIu64,
+			mpsp->stats.capacity,
+			mpsp->stats.allocated,
+			mpsp->stats.in_use,
+			mpsp->stats.max_in_use,
+			mpsp->stats.heap_allocations,
+			mpsp->stats.alloc_failures);
+		break;
+	case MID_CLOCK_STATS_NP:
+		csnp = (struct clock_stats_np *) mgt->data;
+		fprintf(fp, "CLOCK_STATS_NP ");
+		pmc_show_histogram("offset", &csnp->offset, fp);
+		pmc_show_histogram("delay", &csnp->delay, fp);
+		break;
 	case MID_SUBSCRIBE_EVENTS_NP:
 		sen = (struct subscribe_events_np *) mgt->data;
 		fprintf(fp, "SUBSCRIBE_EVENTS_NP "
@@ -268,6 +268,11 @@ void pmc_agent_disable(struct pmc_agent *agent)
 	agent->pmc = NULL;
 }
 
+int pmc_agent_get_fd(struct pmc_agent *agent)
+{
+	return agent->pmc ? pmc_get_transport_fd(agent->pmc) : -1;
+}
+
 int pmc_agent_get_leap(struct pmc_agent *agent)
 {
 	return agent->leap;
@@ -401,9 +406,8 @@ int pmc_agent_subscribe(struct pmc_agent *node, int timeout, int interval)
 	return renew_subscription(node, timeout);
 }
 
-int pmc_agent_update(struct pmc_agent *node)
+int pmc_agent_renew(struct pmc_agent *node)
 {
-	struct ptp_message *msg;
 	struct timespec tp;
 	uint64_t ts;
 
@@ -424,12 +428,32 @@ int pmc_agent_update(struct pmc_agent *node)
 			node->pmc_last_update = ts;
 		}
 	}
+	return 0;
+}
+
+int pmc_agent_recv(struct pmc_agent *node)
+{
+	struct ptp_message *msg;
 
+	if (!node->pmc) {
+		return 0;
+	}
 	run_pmc(node, 0, -1, &msg);
 
 	return 0;
 }
 
+int pmc_agent_update(struct pmc_agent *node)
+{
+	int err;
+
+	err = pmc_agent_renew(node);
+	if (err) {
+		return err;
+	}
+	return pmc_agent_recv(node);
+}
+
 int pmc_agent_is_subscribed(struct pmc_agent *agent)
 {
 	struct timespec tp;
@@ -54,6 +54,13 @@ void pmc_agent_destroy(struct pmc_agent *agent);
  */
 void pmc_agent_disable(struct pmc_agent *agent);
 
+/**
+ * Gets the descriptor of the connection to the ptp4l service.
+ * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
+ * @return       The descriptor, or -1 when the agent is not connected.
+ */
+int pmc_agent_get_fd(struct pmc_agent *agent);
+
 /**
  * Gets the current leap adjustment.
  * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
@@ -166,6 +173,26 @@ int pmc_agent_subscribe(struct pmc_agent *agent, int timeout, int interval);
  */
 int pmc_agent_update(struct pmc_agent *agent);
 
+/**
+ * Renews the subscription and queries the TAI-UTC offset when due, like
+ * @ref pmc_agent_update(), but without polling for notifications. The
+ * replies are read by @ref pmc_agent_recv().
+ *
+ * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
+ * @return       Zero on success, negative error code otherwise.
+ */
+int pmc_agent_renew(struct pmc_agent *agent);
+
+/**
+ * Reads one pending message from the ptp4l service, if any, invoking the
+ * port state notification callback as needed. Intended for callers which
+ * wait for the descriptor from @ref pmc_agent_get_fd() to become readable.
+ *
+ * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
+ * @return       Zero on success, negative error code otherwise.
+ */
+int pmc_agent_recv(struct pmc_agent *agent);
+
 /**
  * Checks if last successful subscription did not run out, i.e. ptp4l is still
  * responding (assuming pmc_agent_update() is called frequently enough).
@@ -131,6 +131,8 @@ struct management_id idtab[] = {
 	{ "GRANDMASTER_SETTINGS_NP", MID_GRANDMASTER_SETTINGS_NP, do_set_action },
 	{ "SUBSCRIBE_EVENTS_NP", MID_SUBSCRIBE_EVENTS_NP, do_set_action },
 	{ "SYNCHRONIZATION_UNCERTAIN_NP", MID_SYNCHRONIZATION_UNCERTAIN_NP, do_set_action },
+	{ "MESSAGE_POOL_STATS_NP", MID_MESSAGE_POOL_STATS_NP, do_get_action },
+	{ "CLOCK_STATS_NP", MID_CLOCK_STATS_NP, do_get_action },
 /* Port management ID values */
 	{ "NULL_MANAGEMENT", MID_NULL_MANAGEMENT, null_management },
 	{ "CLOCK_DESCRIPTION", MID_CLOCK_DESCRIPTION, do_get_action },
@@ -656,6 +658,12 @@ static int pmc_tlv_datalen(struct pmc *pmc, int id)
 	case MID_SUBSCRIBE_EVENTS_NP:
 		len += sizeof(struct subscribe_events_np);
 		break;
+	case MID_MESSAGE_POOL_STATS_NP:
+		len += sizeof(struct message_pool_stats_np);
+		break;
+	case MID_CLOCK_STATS_NP:
+		len += sizeof(struct clock_stats_np);
+		break;
 	case MID_NULL_MANAGEMENT:
 		break;
 	case MID_CLOCK_DESCRIPTION:
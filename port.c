@@ -59,6 +59,17 @@ enum syfu_event {
 static int port_is_ieee8021as(struct port *p);
 static int port_is_uds(struct port *p);
 static void port_nrate_initialize(struct port *p);
+static void port_peer_delay(struct port *p);
+static int port_send(struct port *p, struct ptp_message *msg,
+		     enum transport_event event);
+static int port_txts_prune(struct port *p, struct timespec *now);
+static struct txts_pending *port_txts_queue(struct port *p,
+					    struct ptp_message *msg,
+					    int (*complete)(struct port *p,
+							    struct txts_pending *txp,
+							    tmv_t ts),
+					    struct timespec *sent);
+static int port_txts_store(struct port *p, struct txts_pending *txp, tmv_t ts);
 
 static int announce_compare(struct ptp_message *m1, struct ptp_message *m2)
 {
@@ -370,6 +381,28 @@ void ts_add(tmv_t *ts, Integer64 correction)
 	*ts = tmv_add(*ts, correction_to_tmv(correction));
 }
 
+/*
+ * The master of the port before a warm restart qualifies with its first
+ * announce message, as long as the checkpoint is not too old.
+ */
+static unsigned int fc_threshold(struct port *p, struct foreign_clock *fc)
+{
+	struct timespec now;
+
+	if (!p->warm_parent_valid) {
+		return FOREIGN_MASTER_THRESHOLD;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec >= p->warm_until) {
+		p->warm_parent_valid = 0;
+		return FOREIGN_MASTER_THRESHOLD;
+	}
+	if (pid_eq(&fc->dataset.sender, &p->warm_parent)) {
+		return 1;
+	}
+	return FOREIGN_MASTER_THRESHOLD;
+}
+
 /*
  * Returns non-zero if the announce message is different than last.
  */
@@ -404,14 +437,16 @@ static int add_foreign_master(struct port *p, struct ptp_message *m)
 		fc->port = p;
 		fc->dataset.sender = m->header.sourcePortIdentity;
 		/* We do not count this first message, see 9.5.3(b) */
-		return 0;
+		if (fc_threshold(p, fc) == FOREIGN_MASTER_THRESHOLD) {
+			return 0;
+		}
 	}
 
 	/*
 	 * If this message breaks the threshold, that is an important change.
 	 */
 	fc_prune(fc);
-	if (FOREIGN_MASTER_THRESHOLD - 1 == fc->n_messages) {
+	if (fc_threshold(p, fc) - 1 == fc->n_messages) {
 		broke_threshold = 1;
 	}
 
@@ -422,6 +457,12 @@ static int add_foreign_master(struct port *p, struct ptp_message *m)
 	fc->n_messages++;
 	TAILQ_INSERT_HEAD(&fc->messages, m, list);
 
+	/* Once qualified by the normal rule, the warm start is over. */
+	if (fc->n_messages >= FOREIGN_MASTER_THRESHOLD &&
+	    fc_threshold(p, fc) != FOREIGN_MASTER_THRESHOLD) {
+		p->warm_parent_valid = 0;
+	}
+
 	/*
 	 * Test if this announcement contains changed information.
 	 */
@@ -560,6 +601,9 @@ static struct follow_up_info_tlv *follow_up_info_extract(struct ptp_message *m)
 	struct follow_up_info_tlv *f;
 	struct tlv_extra *extra;
 
+	if (msg_tlv_unpack(m, TLV_ORGANIZATION_EXTENSION)) {
+		return NULL;
+	}
 	TAILQ_FOREACH(extra, &m->tlv_list, list) {
 		f = (struct follow_up_info_tlv *) extra->tlv;
 		if (f->type == TLV_ORGANIZATION_EXTENSION &&
@@ -645,6 +689,9 @@ static int path_trace_ignore(struct port *p, struct ptp_message *m)
 	if (msg_type(m) != ANNOUNCE) {
 		return 0;
 	}
+	if (msg_tlv_unpack(m, TLV_PATH_TRACE)) {
+		return 1;
+	}
 	TAILQ_FOREACH(extra, &m->tlv_list, list) {
 		ptt = (struct path_trace_tlv *) extra->tlv;
 		if (ptt->type != TLV_PATH_TRACE) {
@@ -821,6 +868,9 @@ static int port_nsm_reply(struct port *p, struct ptp_message *m)
 	if (!msg_unicast(m)) {
 		return 0;
 	}
+	if (msg_tlv_unpack(m, TLV_PTPMON_REQ)) {
+		return 0;
+	}
 	TAILQ_FOREACH(extra, &m->tlv_list, list) {
 		if (extra->tlv->type == TLV_PTPMON_REQ) {
 			return 1;
@@ -1347,6 +1397,7 @@ static void message_interval_request(struct port *p,
 	if (last_state == SERVO_LOCKED) {
 		p->logPdelayReqInterval = p->operLogPdelayReqInterval;
 		p->logSyncInterval = p->operLogSyncInterval;
+		port_sync_tmpl_flush(p);
 		port_tx_interval_request(p, SIGNAL_NO_CHANGE,
 					 p->logSyncInterval,
 					 SIGNAL_NO_CHANGE);
@@ -1361,6 +1412,57 @@ static void message_interval_request(struct port *p,
 	}
 }
 
+/*
+ * Ask the master for high message rates while the servo acquires lock,
+ * using the unicast grants or else the message interval request TLV.
+ */
+static void port_fast_acquisition_start(struct port *p)
+{
+	if (!p->fast_acquisition || p->fast_acquiring)
+		return;
+
+	p->fast_acquiring = 1;
+	pr_info("%s: fast acquisition at sync interval 2^%d",
+		p->log_name, p->fastLogSyncInterval);
+	if (unicast_client_enabled(p)) {
+		unicast_client_rate_changed(p);
+	} else {
+		port_tx_interval_request(p, SIGNAL_NO_CHANGE,
+					 p->fastLogSyncInterval,
+					 SIGNAL_NO_CHANGE);
+	}
+}
+
+static void port_fast_acquisition_stop(struct port *p)
+{
+	if (!p->fast_acquiring)
+		return;
+
+	p->fast_acquiring = 0;
+	pr_info("%s: fast acquisition done, restoring the message rates",
+		p->log_name);
+	if (unicast_client_enabled(p)) {
+		unicast_client_rate_changed(p);
+	} else if (p->msg_interval_request) {
+		/*
+		 * Going back to the initial rate would contradict the
+		 * operational rate requested by message_interval_request().
+		 */
+		if (p->logSyncInterval == p->operLogSyncInterval)
+			return;
+		p->logPdelayReqInterval = p->operLogPdelayReqInterval;
+		p->logSyncInterval = p->operLogSyncInterval;
+		port_sync_tmpl_flush(p);
+		port_tx_interval_request(p, SIGNAL_NO_CHANGE,
+					 p->logSyncInterval,
+					 SIGNAL_NO_CHANGE);
+	} else {
+		port_tx_interval_request(p, SIGNAL_NO_CHANGE,
+					 SIGNAL_SET_INITIAL,
+					 SIGNAL_NO_CHANGE);
+	}
+}
+
 static void port_synchronize(struct port *p,
 			     uint16_t seqid,
 			     tmv_t ingress_ts,
@@ -1370,6 +1472,7 @@ static void port_synchronize(struct port *p,
 {
 	enum servo_state state, last_state;
 	tmv_t t1, t1c, t2, c1, c2;
+	int pending;
 
 	if (port_set_sync_rx_tmo(p) < 0) {
 		pr_err("Failed to set sync rx timeout timer: %s", strerror(errno));
@@ -1393,14 +1496,20 @@ static void port_synchronize(struct port *p,
 	}
 
 	last_state = clock_servo_state(p->clock);
-	state = clock_synchronize(p->clock, t2, t1c);
+	state = clock_synchronize(p->clock, t2, t1c, &pending);
+	if (pending) {
+		/* The servo was not updated, so there is nothing to act on. */
+		return;
+	}
 	switch (state) {
 	case SERVO_UNLOCKED:
 		port_dispatch(p, EV_SYNCHRONIZATION_FAULT, 0);
 		if (servo_offset_threshold(clock_servo(p->clock)) != 0 &&
-		    sync_interval != p->initialLogSyncInterval) {
+		    sync_interval != p->initialLogSyncInterval &&
+		    !p->fast_acquiring) {
 			p->logPdelayReqInterval = p->logMinPdelayReqInterval;
 			p->logSyncInterval = p->initialLogSyncInterval;
+			port_sync_tmpl_flush(p);
 			port_tx_interval_request(p, SIGNAL_NO_CHANGE,
 						 SIGNAL_SET_INITIAL,
 						 SIGNAL_NO_CHANGE);
@@ -1415,10 +1524,14 @@ static void port_synchronize(struct port *p,
 		}
 		break;
 	case SERVO_LOCKED:
+		/* Without an offset threshold the servo is never stable. */
+		if (!servo_offset_threshold(clock_servo(p->clock)))
+			port_fast_acquisition_stop(p);
 		port_dispatch(p, EV_MASTER_CLOCK_SELECTED, 0);
 		break;
 	case SERVO_LOCKED_STABLE:
 		message_interval_request(p, last_state, sync_interval);
+		port_fast_acquisition_stop(p);
 		port_dispatch(p, EV_MASTER_CLOCK_SELECTED, 0);
 		break;
 	}
@@ -1614,12 +1727,17 @@ static int port_pdelay_request(struct port *p)
 		msg->header.flagField[0] |= UNICAST;
 	}
 
-	err = peer_prepare_and_send(p, msg, TRANS_EVENT);
+	err = peer_prepare_and_send(p, msg, p->tx_async ?
+				    TRANS_DEFER_EVENT : TRANS_EVENT);
 	if (err) {
 		pr_err("%s: send peer delay request failed", p->log_name);
 		goto out;
 	}
-	if (msg_sots_missing(msg)) {
+	if (p->tx_async) {
+		if (!port_txts_park(p, msg, port_txts_store)) {
+			goto out;
+		}
+	} else if (msg_sots_missing(msg)) {
 		pr_err("missing timestamp on transmitted peer delay request");
 		goto out;
 	}
@@ -1677,11 +1795,16 @@ int port_delay_request(struct port *p)
 		msg->header.flagField[0] |= UNICAST;
 	}
 
-	if (port_prepare_and_send(p, msg, TRANS_EVENT)) {
+	if (port_prepare_and_send(p, msg, p->tx_async ?
+				  TRANS_DEFER_EVENT : TRANS_EVENT)) {
 		pr_err("%s: send delay request failed", p->log_name);
 		goto out;
 	}
-	if (msg_sots_missing(msg)) {
+	if (p->tx_async) {
+		if (!port_txts_park(p, msg, port_txts_store)) {
+			goto out;
+		}
+	} else if (msg_sots_missing(msg)) {
 		pr_err("missing timestamp on transmitted delay request");
 		goto out;
 	}
@@ -1694,22 +1817,17 @@ out:
 	return -1;
 }
 
-int port_tx_announce(struct port *p, struct address *dst, uint16_t sequence_id)
+static struct ptp_message *port_announce_msg(struct port *p,
+					     struct address *dst,
+					     uint16_t sequence_id)
 {
 	struct timePropertiesDS tp = clock_time_properties(p->clock);
 	struct parent_ds *dad = clock_parent_ds(p->clock);
 	struct ptp_message *msg;
-	int err;
 
-	if (p->inhibit_multicast_service && !dst) {
-		return 0;
-	}
-	if (!port_capable(p)) {
-		return 0;
-	}
 	msg = msg_allocate();
 	if (!msg) {
-		return -1;
+		return NULL;
 	}
 
 	msg->hwts.type = p->timestamping;
@@ -1745,6 +1863,24 @@ int port_tx_announce(struct port *p, struct address *dst, uint16_t sequence_id)
 	if (clock_append_timezones(p->clock, msg)) {
 		pr_err("%s: append time zones failed", p->log_name);
 	}
+	return msg;
+}
+
+int port_tx_announce(struct port *p, struct address *dst, uint16_t sequence_id)
+{
+	struct ptp_message *msg;
+	int err;
+
+	if (p->inhibit_multicast_service && !dst) {
+		return 0;
+	}
+	if (!port_capable(p)) {
+		return 0;
+	}
+	msg = port_announce_msg(p, dst, sequence_id);
+	if (!msg) {
+		return -1;
+	}
 
 	err = port_prepare_and_send(p, msg, TRANS_GENERAL);
 	if (err) {
@@ -1754,16 +1890,213 @@ int port_tx_announce(struct port *p, struct address *dst, uint16_t sequence_id)
 	return err;
 }
 
+/*
+ * Sends messages already in network byte order with as few system
+ * calls as the transport allows. Returns the number of messages sent.
+ */
+static int port_sendmany(struct port *p, struct ptp_message **msg, int n,
+			 enum transport_event event)
+{
+	int cnt, i;
+
+	cnt = transport_sendmany(p->trp, &p->fda, event, msg, n);
+	if (cnt <= 0) {
+		return 0;
+	}
+	for (i = 0; i < cnt; i++) {
+		port_stats_inc_tx(p, msg[i]);
+	}
+	return cnt;
+}
+
+int port_tx_announce_batch(struct port *p, struct address **dst,
+			   uint16_t *sequence_id, int n)
+{
+	struct ptp_message *msg[TRANSPORT_BATCH_MAX];
+	int cnt, err = 0, i;
+
+	if (!port_capable(p)) {
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		msg[i] = port_announce_msg(p, dst[i], sequence_id[i]);
+		if (!msg[i]) {
+			err = -1;
+			break;
+		}
+		if (msg_pre_send(msg[i])) {
+			msg_put(msg[i]);
+			err = -1;
+			break;
+		}
+	}
+	n = i;
+
+	cnt = port_sendmany(p, msg, n, TRANS_GENERAL);
+	if (cnt < n) {
+		pr_err("%s: send announce failed", p->log_name);
+		err = -1;
+	}
+	for (i = 0; i < n; i++) {
+		msg_put(msg[i]);
+	}
+	return err;
+}
+
+static struct ptp_message *port_build_fup(struct port *p)
+{
+	struct ptp_message *fup;
+
+	fup = msg_allocate();
+	if (!fup) {
+		return NULL;
+	}
+
+	fup->hwts.type = p->timestamping;
+
+	fup->header.tsmt               = FOLLOW_UP | p->transportSpecific;
+	fup->header.ver                = ptp_hdr_ver;
+	fup->header.messageLength      = sizeof(struct follow_up_msg);
+	fup->header.domainNumber       = clock_domain_number(p->clock);
+	fup->header.sourcePortIdentity = p->portIdentity;
+	fup->header.logMessageInterval = p->logSyncInterval;
+
+	if (p->follow_up_info && follow_up_info_append(fup)) {
+		pr_err("%s: append fup info failed", p->log_name);
+		msg_put(fup);
+		return NULL;
+	}
+	return fup;
+}
+
+static struct ptp_message *port_build_sync(struct port *p)
+{
+	struct ptp_message *msg;
+
+	msg = msg_allocate();
+	if (!msg) {
+		return NULL;
+	}
+
+	msg->hwts.type = p->timestamping;
+
+	msg->header.tsmt               = SYNC | p->transportSpecific;
+	msg->header.ver                = ptp_hdr_ver;
+	msg->header.messageLength      = sizeof(struct sync_msg);
+	msg->header.domainNumber       = clock_domain_number(p->clock);
+	msg->header.sourcePortIdentity = p->portIdentity;
+	msg->header.logMessageInterval = p->logSyncInterval;
+
+	if (p->timestamping != TS_ONESTEP && p->timestamping != TS_P2P1STEP) {
+		msg->header.flagField[0] |= TWO_STEP;
+	}
+	return msg;
+}
+
+void port_sync_tmpl_flush(struct port *p)
+{
+	if (p->sync_tmpl) {
+		msg_put(p->sync_tmpl);
+		p->sync_tmpl = NULL;
+	}
+	if (p->fup_tmpl) {
+		msg_put(p->fup_tmpl);
+		p->fup_tmpl = NULL;
+	}
+}
+
+/*
+ * The Sync and Follow_Up messages of a port differ only in a few
+ * fields, so they are built once in network byte order and copied.
+ */
+static int port_sync_tmpl_update(struct port *p)
+{
+	if (p->sync_tmpl) {
+		return 0;
+	}
+	p->sync_tmpl = port_build_sync(p);
+	p->fup_tmpl = port_build_fup(p);
+	if (!p->sync_tmpl || !p->fup_tmpl ||
+	    msg_pre_send(p->sync_tmpl) || msg_pre_send(p->fup_tmpl)) {
+		port_sync_tmpl_flush(p);
+		return -1;
+	}
+	return 0;
+}
+
+static struct ptp_message *port_sync_fup(struct port *p, struct address *dst,
+					 uint16_t sequence_id)
+{
+	struct ptp_message *fup;
+
+	if (port_sync_tmpl_update(p)) {
+		return NULL;
+	}
+	fup = msg_from_template(p->fup_tmpl);
+	if (!fup) {
+		return NULL;
+	}
+	fup->header.sequenceId = htons(sequence_id);
+
+	if (dst) {
+		fup->address = *dst;
+		fup->header.flagField[0] |= UNICAST;
+	}
+	return fup;
+}
+
+static struct ptp_message *port_sync_msg(struct port *p, struct address *dst,
+					 uint16_t sequence_id)
+{
+	struct ptp_message *msg;
+
+	if (port_sync_tmpl_update(p)) {
+		return NULL;
+	}
+	msg = msg_from_template(p->sync_tmpl);
+	if (!msg) {
+		return NULL;
+	}
+	msg->header.sequenceId = htons(sequence_id);
+
+	if (dst) {
+		msg->address = *dst;
+		msg->header.flagField[0] |= UNICAST;
+		msg->header.logMessageInterval = 0x7f;
+	}
+	return msg;
+}
+
+static int port_send_fup(struct port *p, struct ptp_message *fup, tmv_t ts)
+{
+	int err;
+
+	fup->follow_up.preciseOriginTimestamp = tmv_to_Timestamp(ts);
+	msg_timestamp_pre_send(&fup->follow_up.preciseOriginTimestamp);
+
+	err = port_send(p, fup, TRANS_GENERAL);
+	if (err) {
+		pr_err("%s: send follow up failed", p->log_name);
+	}
+	return err;
+}
+
+static int port_txts_sync(struct port *p, struct txts_pending *txp, tmv_t ts)
+{
+	return port_send_fup(p, txp->fup, ts);
+}
+
 int port_tx_sync(struct port *p, struct address *dst, uint16_t sequence_id)
 {
-	struct ptp_message *msg, *fup;
+	struct ptp_message *msg, *fup = NULL;
+	struct txts_pending *txp;
 	int err, event;
 
 	switch (p->timestamping) {
 	case TS_SOFTWARE:
 	case TS_LEGACY_HW:
 	case TS_HARDWARE:
-		event = TRANS_EVENT;
+		event = p->tx_async ? TRANS_DEFER_EVENT : TRANS_EVENT;
 		break;
 	case TS_ONESTEP:
 		event = TRANS_ONESTEP;
@@ -1784,42 +2117,37 @@ int port_tx_sync(struct port *p, struct address *dst, uint16_t sequence_id)
 	if (port_sync_incapable(p)) {
 		return 0;
 	}
-	msg = msg_allocate();
+	msg = port_sync_msg(p, dst, sequence_id);
 	if (!msg) {
 		return -1;
 	}
-	fup = msg_allocate();
-	if (!fup) {
-		msg_put(msg);
-		return -1;
-	}
-
-	msg->hwts.type = p->timestamping;
-
-	msg->header.tsmt               = SYNC | p->transportSpecific;
-	msg->header.ver                = ptp_hdr_ver;
-	msg->header.messageLength      = sizeof(struct sync_msg);
-	msg->header.domainNumber       = clock_domain_number(p->clock);
-	msg->header.sourcePortIdentity = p->portIdentity;
-	msg->header.sequenceId         = sequence_id;
-	msg->header.logMessageInterval = p->logSyncInterval;
-
 	if (p->timestamping != TS_ONESTEP && p->timestamping != TS_P2P1STEP) {
-		msg->header.flagField[0] |= TWO_STEP;
+		fup = port_sync_fup(p, dst, sequence_id);
+		if (!fup) {
+			msg_put(msg);
+			return -1;
+		}
 	}
 
-	if (dst) {
-		msg->address = *dst;
-		msg->header.flagField[0] |= UNICAST;
-		msg->header.logMessageInterval = 0x7f;
-	}
-	err = port_prepare_and_send(p, msg, event);
+	err = port_send(p, msg, event);
 	if (err) {
 		pr_err("%s: send sync failed", p->log_name);
 		goto out;
 	}
 	if (p->timestamping == TS_ONESTEP || p->timestamping == TS_P2P1STEP) {
 		goto out;
+	} else if (event == TRANS_DEFER_EVENT) {
+		/*
+		 * The follow up goes out once the time stamp arrives.
+		 */
+		txp = port_txts_park(p, msg, port_txts_sync);
+		if (!txp) {
+			err = -1;
+			goto out;
+		}
+		txp->fup = fup;
+		fup = NULL;
+		goto out;
 	} else if (msg_sots_missing(msg)) {
 		pr_err("missing timestamp on transmitted sync");
 		err = -1;
@@ -1829,35 +2157,105 @@ int port_tx_sync(struct port *p, struct address *dst, uint16_t sequence_id)
 	/*
 	 * Send the follow up message right away.
 	 */
-	fup->hwts.type = p->timestamping;
+	err = port_send_fup(p, fup, msg->hwts.ts);
+out:
+	msg_put(msg);
+	if (fup) {
+		msg_put(fup);
+	}
+	return err;
+}
 
-	fup->header.tsmt               = FOLLOW_UP | p->transportSpecific;
-	fup->header.ver                = ptp_hdr_ver;
-	fup->header.messageLength      = sizeof(struct follow_up_msg);
-	fup->header.domainNumber       = clock_domain_number(p->clock);
-	fup->header.sourcePortIdentity = p->portIdentity;
-	fup->header.sequenceId         = sequence_id;
-	fup->header.logMessageInterval = p->logSyncInterval;
+int port_tx_sync_batch(struct port *p, struct address **dst,
+		       uint16_t *sequence_id, int n)
+{
+	struct ptp_message *msg[TRANSPORT_BATCH_MAX], *fup[TRANSPORT_BATCH_MAX];
+	struct txts_pending *txp;
+	struct timespec now;
+	int cnt, err = 0, i;
+	int event;
 
-	fup->follow_up.preciseOriginTimestamp = tmv_to_Timestamp(msg->hwts.ts);
+	switch (p->timestamping) {
+	case TS_SOFTWARE:
+	case TS_LEGACY_HW:
+	case TS_HARDWARE:
+		if (!p->tx_async) {
+			/* Each time stamp must be fetched right away. */
+			for (i = 0; i < n; i++) {
+				if (port_tx_sync(p, dst[i], sequence_id[i])) {
+					err = -1;
+				}
+			}
+			return err;
+		}
+		event = TRANS_DEFER_EVENT;
+		break;
+	case TS_ONESTEP:
+		event = TRANS_ONESTEP;
+		break;
+	case TS_P2P1STEP:
+		event = TRANS_P2P1STEP;
+		break;
+	default:
+		return -1;
+	}
 
-	if (dst) {
-		fup->address = *dst;
-		fup->header.flagField[0] |= UNICAST;
+	if (!port_capable(p)) {
+		return 0;
 	}
-	if (p->follow_up_info && follow_up_info_append(fup)) {
-		pr_err("%s: append fup info failed", p->log_name);
-		err = -1;
-		goto out;
+	if (port_sync_incapable(p)) {
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		msg[i] = port_sync_msg(p, dst[i], sequence_id[i]);
+		if (!msg[i]) {
+			err = -1;
+			break;
+		}
+		fup[i] = NULL;
+		if (event != TRANS_DEFER_EVENT) {
+			continue;
+		}
+		fup[i] = port_sync_fup(p, dst[i], sequence_id[i]);
+		if (!fup[i]) {
+			msg_put(msg[i]);
+			err = -1;
+			break;
+		}
 	}
+	n = i;
 
-	err = port_prepare_and_send(p, fup, TRANS_GENERAL);
-	if (err) {
-		pr_err("%s: send follow up failed", p->log_name);
+	cnt = port_sendmany(p, msg, n, event);
+	if (cnt < n) {
+		pr_err("%s: send sync failed", p->log_name);
+		err = -1;
+	}
+	if (cnt && event == TRANS_DEFER_EVENT) {
+		/* The whole batch was sent at once. */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (port_txts_prune(p, &now)) {
+			err = -1;
+			cnt = 0;
+		}
+	}
+	for (i = 0; i < cnt && event == TRANS_DEFER_EVENT; i++) {
+		/*
+		 * The follow up goes out once the time stamp arrives.
+		 */
+		txp = port_txts_queue(p, msg[i], port_txts_sync, &now);
+		if (!txp) {
+			err = -1;
+			break;
+		}
+		txp->fup = fup[i];
+		fup[i] = NULL;
+	}
+	for (i = 0; i < n; i++) {
+		msg_put(msg[i]);
+		if (fup[i]) {
+			msg_put(fup[i]);
+		}
 	}
-out:
-	msg_put(msg);
-	msg_put(fup);
 	return err;
 }
 
@@ -1916,6 +2314,216 @@ static void flush_peer_delay(struct port *p)
 	}
 }
 
+/*
+ * asynchronous transmit time stamps
+ */
+static void port_txts_recycle(struct port *p, struct txts_pending *txp)
+{
+	msg_put(txp->msg);
+	if (txp->fup) {
+		msg_put(txp->fup);
+	}
+	TAILQ_INSERT_HEAD(&p->txts_pool, txp, list);
+}
+
+static void flush_txts_pending(struct port *p)
+{
+	struct txts_pending *txp;
+
+	while ((txp = TAILQ_FIRST(&p->txts_pending)) != NULL) {
+		TAILQ_REMOVE(&p->txts_pending, txp, list);
+		port_txts_recycle(p, txp);
+	}
+}
+
+static int port_txts_current(struct txts_pending *txp, struct timespec now)
+{
+	int64_t t1, t2;
+
+	t1 = txp->sent.tv_sec * NSEC_PER_SEC + txp->sent.tv_nsec;
+	t2 = now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+
+	return t2 - t1 < (int64_t) sk_tx_timeout * 1000000;
+}
+
+/*
+ * Arms the time stamp timer for the oldest pending message. The timer
+ * is not disarmed when that message completes, it then expires early
+ * and is armed again for the next one.
+ */
+static int port_txts_set_tmo(struct port *p)
+{
+	struct itimerspec tmo = {
+		{0, 0}, {0, 0}
+	};
+	struct txts_pending *txp;
+	int64_t ns;
+
+	txp = TAILQ_FIRST(&p->txts_pending);
+	if (!txp) {
+		return port_clr_tmo(p->fda.fd[FD_TXTS_TIMER]);
+	}
+	ns = txp->sent.tv_sec * NSEC_PER_SEC + txp->sent.tv_nsec +
+		(int64_t) sk_tx_timeout * 1000000;
+	tmo.it_value.tv_sec = ns / NSEC_PER_SEC;
+	tmo.it_value.tv_nsec = ns % NSEC_PER_SEC;
+	return timerfd_settime(p->fda.fd[FD_TXTS_TIMER], TFD_TIMER_ABSTIME,
+			       &tmo, NULL);
+}
+
+/*
+ * Returns the number of messages whose time stamps never arrived.
+ */
+static int port_txts_prune(struct port *p, struct timespec *now)
+{
+	struct txts_pending *txp;
+	int cnt = 0;
+
+	while ((txp = TAILQ_FIRST(&p->txts_pending)) != NULL) {
+		if (port_txts_current(txp, *now)) {
+			break;
+		}
+		pr_err("%s: timed out while waiting for tx timestamp of %s",
+		       p->log_name, msg_type_string(msg_type(txp->msg)));
+		TAILQ_REMOVE(&p->txts_pending, txp, list);
+		port_txts_recycle(p, txp);
+		cnt++;
+	}
+	if (cnt) {
+		pr_err("increasing tx_timestamp_timeout or increasing "
+		       "kworker priority may correct this issue, "
+		       "but a driver bug likely causes it");
+	}
+	return cnt;
+}
+
+/*
+ * Queues a message sent at the given time for its time stamp.
+ */
+static struct txts_pending *port_txts_queue(struct port *p,
+					    struct ptp_message *msg,
+					    int (*complete)(struct port *p,
+							    struct txts_pending *txp,
+							    tmv_t ts),
+					    struct timespec *sent)
+{
+	struct txts_pending *txp;
+
+	txp = TAILQ_FIRST(&p->txts_pool);
+	if (txp) {
+		TAILQ_REMOVE(&p->txts_pool, txp, list);
+		memset(txp, 0, sizeof(*txp));
+	} else {
+		txp = calloc(1, sizeof(*txp));
+		if (!txp) {
+			return NULL;
+		}
+	}
+	msg_get(msg);
+	txp->msg = msg;
+	txp->complete = complete;
+	txp->key = msg->hwts.key;
+	txp->sent = *sent;
+	TAILQ_INSERT_TAIL(&p->txts_pending, txp, list);
+	if (TAILQ_FIRST(&p->txts_pending) == txp) {
+		port_txts_set_tmo(p);
+	}
+	return txp;
+}
+
+struct txts_pending *port_txts_park(struct port *p, struct ptp_message *msg,
+				    int (*complete)(struct port *p,
+						    struct txts_pending *txp,
+						    tmv_t ts))
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (port_txts_prune(p, &now)) {
+		return NULL;
+	}
+	return port_txts_queue(p, msg, complete, &now);
+}
+
+static int port_txts_store(struct port *p, struct txts_pending *txp, tmv_t ts)
+{
+	txp->msg->hwts.ts = ts;
+	if (txp->msg == p->peer_delay_req) {
+		/* The response might have overtaken the time stamp. */
+		port_peer_delay(p);
+	}
+	return 0;
+}
+
+int port_txts_async(struct port *p)
+{
+	return p->tx_async;
+}
+
+enum fsm_event port_txts_event(struct port *p)
+{
+	struct txts_pending *txp;
+	struct hw_timestamp hwts;
+	struct timespec now;
+	int cnt = 0, err;
+	uint32_t key;
+
+	memset(&hwts, 0, sizeof(hwts));
+	hwts.type = p->timestamping;
+
+	while (!(err = transport_txts_async(&p->fda, &hwts, &key))) {
+		cnt++;
+		/* Time stamps usually arrive in order of transmission. */
+		TAILQ_FOREACH(txp, &p->txts_pending, list) {
+			if (txp->key == key) {
+				break;
+			}
+		}
+		if (!txp) {
+			pr_debug("%s: stray tx timestamp %u", p->log_name, key);
+			continue;
+		}
+		TAILQ_REMOVE(&p->txts_pending, txp, list);
+		if (tmv_is_zero(hwts.ts)) {
+			pr_err("%s: missing timestamp on transmitted %s",
+			       p->log_name, msg_type_string(msg_type(txp->msg)));
+			port_txts_recycle(p, txp);
+			return EV_FAULT_DETECTED;
+		}
+		ts_add(&hwts.ts, p->tx_timestamp_offset);
+		err = txp->complete(p, txp, hwts.ts);
+		port_txts_recycle(p, txp);
+		if (err) {
+			return EV_FAULT_DETECTED;
+		}
+	}
+	if (err != -EAGAIN) {
+		return EV_FAULT_DETECTED;
+	}
+	if (!cnt) {
+		err = sk_get_error(p->fda.fd[FD_EVENT]);
+		if (err) {
+			pr_err("%s: error on event socket: %s",
+			       p->log_name, strerror(err));
+			return EV_FAULT_DETECTED;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return port_txts_prune(p, &now) ? EV_FAULT_DETECTED : EV_NONE;
+}
+
+enum fsm_event port_txts_timeout(struct port *p)
+{
+	enum fsm_event event;
+
+	/* Collect the time stamps which arrived in the meantime first. */
+	event = port_txts_event(p);
+	if (port_txts_set_tmo(p)) {
+		return EV_FAULT_DETECTED;
+	}
+	return event;
+}
+
 static void port_clear_fda(struct port *p, int count)
 {
 	int i;
@@ -1956,11 +2564,13 @@ void port_disable(struct port *p)
 	int i;
 
 	tc_flush(p);
+	flush_txts_pending(p);
 	flush_last_sync(p);
 	flush_delay_req(p);
 	flush_peer_delay(p);
 
 	p->best = NULL;
+	p->warm_parent_valid = 0;
 	free_foreign_masters(p);
 	transport_close(p->trp, &p->fda);
 
@@ -1976,7 +2586,7 @@ void port_disable(struct port *p)
 
 	/* Keep rtnl socket to get link status info. */
 	port_clear_fda(p, FD_RTNL);
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 }
 
 int port_initialize(struct port *p)
@@ -1987,7 +2597,8 @@ int port_initialize(struct port *p)
 	p->multiple_seq_pdr_count  = 0;
 	p->multiple_pdr_detected   = 0;
 	p->last_fault_type         = FT_UNSPECIFIED;
-	p->logMinDelayReqInterval  = config_get_int(cfg, p->name, "logMinDelayReqInterval");
+	p->initialLogMinDelayReqInterval = config_get_int(cfg, p->name, "logMinDelayReqInterval");
+	p->logMinDelayReqInterval  = p->initialLogMinDelayReqInterval;
 	p->peerMeanPathDelay       = 0;
 	p->initialLogAnnounceInterval = config_get_int(cfg, p->name, "logAnnounceInterval");
 	p->logAnnounceInterval     = p->initialLogAnnounceInterval;
@@ -2001,14 +2612,19 @@ int port_initialize(struct port *p)
 	p->localPriority           = config_get_int(cfg, p->name, "G.8275.portDS.localPriority");
 	p->initialLogSyncInterval  = config_get_int(cfg, p->name, "logSyncInterval");
 	p->logSyncInterval         = p->initialLogSyncInterval;
+	port_sync_tmpl_flush(p);
 	p->operLogSyncInterval     = config_get_int(cfg, p->name, "operLogSyncInterval");
 	p->logMinPdelayReqInterval = config_get_int(cfg, p->name, "logMinPdelayReqInterval");
 	p->logPdelayReqInterval    = p->logMinPdelayReqInterval;
 	p->operLogPdelayReqInterval = config_get_int(cfg, p->name, "operLogPdelayReqInterval");
+	p->fastLogSyncInterval     = config_get_int(cfg, p->name, "fastLogSyncInterval");
+	p->fastLogMinDelayReqInterval = config_get_int(cfg, p->name, "fastLogMinDelayReqInterval");
+	p->fast_acquiring          = 0;
 	p->neighborPropDelayThresh = config_get_int(cfg, p->name, "neighborPropDelayThresh");
 	p->min_neighbor_prop_delay = config_get_int(cfg, p->name, "min_neighbor_prop_delay");
 	p->delay_response_timeout  = config_get_int(cfg, p->name, "delay_response_timeout");
 	p->iface_rate_tlv 	   = config_get_int(cfg, p->name, "interface_rate_tlv");
+	p->rx_batch                = config_get_int(cfg, p->name, "rx_batch");
 
 	if (config_get_int(cfg, p->name, "asCapable") == AS_CAPABLE_TRUE) {
 		p->asCapable = ALWAYS_CAPABLE;
@@ -2074,7 +2690,7 @@ int port_initialize(struct port *p)
 
 	port_nrate_initialize(p);
 
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 	return 0;
 
 no_tmo:
@@ -2103,10 +2719,12 @@ static int port_renew_transport(struct port *p)
 
 	transport_close(p->trp, &p->fda);
 	port_clear_fda(p, FD_FIRST_TIMER);
+	/* The new event socket starts counting its time stamps afresh. */
+	flush_txts_pending(p);
 	res = transport_open(p->trp, p->iface, &p->fda, p->timestamping);
 	/* Need to call clock_fda_changed even if transport_open failed in
 	 * order to update clock to the now closed descriptors. */
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 	return res;
 }
 
@@ -2120,6 +2738,8 @@ static int update_current_master(struct port *p, struct ptp_message *m)
 	struct parent_ds *dad;
 	struct path_trace_tlv *ptt;
 	struct timePropertiesDS tds;
+	struct tlv_extra *extra;
+	unsigned int len;
 
 	if (!msg_source_equal(m, fc))
 		return add_foreign_master(p, m);
@@ -2130,11 +2750,22 @@ static int update_current_master(struct port *p, struct ptp_message *m)
 		tds.timeSource = m->announce.timeSource;
 		clock_update_time_properties(p->clock, tds);
 	}
-	if (p->path_trace_enabled) {
-		ptt = (struct path_trace_tlv *) m->announce.suffix;
+	if (p->path_trace_enabled && !msg_tlv_unpack(m, TLV_PATH_TRACE)) {
 		dad = clock_parent_ds(p->clock);
-		memcpy(dad->ptl, ptt->cid, ptt->length);
-		dad->path_length = path_length(ptt);
+		len = 0;
+		TAILQ_FOREACH(extra, &m->tlv_list, list) {
+			ptt = (struct path_trace_tlv *) extra->tlv;
+			if (ptt->type != TLV_PATH_TRACE) {
+				continue;
+			}
+			len = path_length(ptt);
+			if (len > PATH_TRACE_MAX) {
+				len = PATH_TRACE_MAX;
+			}
+			memcpy(dad->ptl, ptt->cid, len * sizeof(ptt->cid[0]));
+			break;
+		}
+		dad->path_length = len;
 	}
 	port_set_announce_tmo(p);
 	fc_prune(fc);
@@ -2236,8 +2867,10 @@ static int process_cmlds(struct port *p)
 		p->asCapable = cmlds->as_capable;
 		p->cmlds.timer_count = 0;
 		if (p->state == PS_UNCALIBRATED || p->state == PS_SLAVE) {
+			/* CMLDS provides only the filtered delay. */
 			const tmv_t tx = tmv_zero();
-			clock_peer_delay(p->clock, p->peer_delay, tx, tx, p->nrate.ratio);
+			clock_peer_delay(p->clock, p->peer_delay, tx,
+					 tx, tx, p->nrate.ratio);
 		}
 		break;
 	case MID_SUBSCRIBE_EVENTS_NP:
@@ -2335,6 +2968,11 @@ void process_delay_resp(struct port *p, struct ptp_message *m)
 	if (!req) {
 		return;
 	}
+	if (!msg_sots_valid(req)) {
+		pr_debug("%s: delay response overtook the tx timestamp",
+			 p->log_name);
+		return;
+	}
 
 	/* Valid Delay Response received, reset the counter */
 	p->delay_response_counter = 0;
@@ -2409,10 +3047,55 @@ void process_follow_up(struct port *p, struct ptp_message *m)
 	port_syfufsm(p, event, m);
 }
 
+static struct ptp_message *port_pdelay_resp_fup(struct port *p,
+						struct ptp_message *m)
+{
+	struct ptp_message *fup;
+
+	fup = msg_allocate();
+	if (!fup) {
+		return NULL;
+	}
+
+	fup->hwts.type = p->timestamping;
+
+	fup->header.tsmt               = PDELAY_RESP_FOLLOW_UP | p->transportSpecific;
+	fup->header.ver                = ptp_hdr_ver;
+	fup->header.messageLength      = sizeof(struct pdelay_resp_fup_msg);
+	fup->header.domainNumber       = m->header.domainNumber;
+	fup->header.correction         = m->header.correction;
+	fup->header.sourcePortIdentity = p->portIdentity;
+	fup->header.sequenceId         = m->header.sequenceId;
+	fup->header.logMessageInterval = 0x7f;
+
+	fup->pdelay_resp_fup.requestingPortIdentity = m->header.sourcePortIdentity;
+
+	if (msg_unicast(m)) {
+		fup->address = m->address;
+		fup->header.flagField[0] |= UNICAST;
+	}
+	return fup;
+}
+
+static int port_txts_pdelay_resp(struct port *p, struct txts_pending *txp,
+				 tmv_t ts)
+{
+	int err;
+
+	txp->fup->pdelay_resp_fup.responseOriginTimestamp = tmv_to_Timestamp(ts);
+
+	err = peer_prepare_and_send(p, txp->fup, TRANS_GENERAL);
+	if (err) {
+		pr_err("%s: send pdelay_resp_fup failed", p->log_name);
+	}
+	return err;
+}
+
 int process_pdelay_req(struct port *p, struct ptp_message *m)
 {
 	struct ptp_message *rsp, *fup;
 	enum transport_event event;
+	struct txts_pending *txp;
 	int err;
 
 	switch (p->timestamping) {
@@ -2420,7 +3103,7 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 	case TS_LEGACY_HW:
 	case TS_HARDWARE:
 	case TS_ONESTEP:
-		event = TRANS_EVENT;
+		event = p->tx_async ? TRANS_DEFER_EVENT : TRANS_EVENT;
 		break;
 	case TS_P2P1STEP:
 		event = TRANS_P2P1STEP;
@@ -2462,7 +3145,7 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 		return -1;
 	}
 
-	fup = msg_allocate();
+	fup = port_pdelay_resp_fup(p, m);
 	if (!fup) {
 		msg_put(rsp);
 		return -1;
@@ -2506,6 +3189,18 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 	}
 	if (p->timestamping == TS_P2P1STEP) {
 		goto out;
+	} else if (event == TRANS_DEFER_EVENT) {
+		/*
+		 * The follow up goes out once the time stamp arrives.
+		 */
+		txp = port_txts_park(p, rsp, port_txts_pdelay_resp);
+		if (!txp) {
+			err = -1;
+			goto out;
+		}
+		txp->fup = fup;
+		fup = NULL;
+		goto out;
 	} else if (msg_sots_missing(rsp)) {
 		pr_err("missing timestamp on transmitted peer delay response");
 		err = -1;
@@ -2515,34 +3210,18 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 	/*
 	 * Send the follow up message right away.
 	 */
-	fup->hwts.type = p->timestamping;
-
-	fup->header.tsmt               = PDELAY_RESP_FOLLOW_UP | p->transportSpecific;
-	fup->header.ver                = ptp_hdr_ver;
-	fup->header.messageLength      = sizeof(struct pdelay_resp_fup_msg);
-	fup->header.domainNumber       = m->header.domainNumber;
-	fup->header.correction         = m->header.correction;
-	fup->header.sourcePortIdentity = p->portIdentity;
-	fup->header.sequenceId         = m->header.sequenceId;
-	fup->header.logMessageInterval = 0x7f;
-
-	fup->pdelay_resp_fup.requestingPortIdentity = m->header.sourcePortIdentity;
-
 	fup->pdelay_resp_fup.responseOriginTimestamp =
 		tmv_to_Timestamp(rsp->hwts.ts);
 
-	if (msg_unicast(m)) {
-		fup->address = m->address;
-		fup->header.flagField[0] |= UNICAST;
-	}
-
 	err = peer_prepare_and_send(p, fup, TRANS_GENERAL);
 	if (err) {
 		pr_err("%s: send pdelay_resp_fup failed", p->log_name);
 	}
 out:
 	msg_put(rsp);
-	msg_put(fup);
+	if (fup) {
+		msg_put(fup);
+	}
 	return err;
 }
 
@@ -2564,6 +3243,10 @@ static void port_peer_delay(struct port *p)
 	if (rsp->header.sequenceId != ntohs(req->header.sequenceId))
 		return;
 
+	/* Wait for the transmit time stamp of the request. */
+	if (!msg_sots_valid(req))
+		return;
+
 	t1 = req->hwts.ts;
 	t4 = rsp->hwts.ts;
 	c1 = correction_to_tmv(rsp->header.correction + p->asymmetry);
@@ -2616,7 +3299,8 @@ calc:
 	p->peerMeanPathDelay = tmv_to_TimeInterval(p->peer_delay);
 
 	if (p->state == PS_UNCALIBRATED || p->state == PS_SLAVE) {
-		clock_peer_delay(p->clock, p->peer_delay, t1, t2,
+		clock_peer_delay(p->clock, p->peer_delay,
+				 tsproc_raw_delay(p->tsproc), t1, t2,
 				 p->nrate.ratio);
 	}
 
@@ -2746,6 +3430,8 @@ void process_sync(struct port *p, struct ptp_message *m)
 
 void port_close(struct port *p)
 {
+	struct txts_pending *txp;
+
 	if (port_is_enabled(p)) {
 		port_cancel_unicast(p);
 		port_disable(p);
@@ -2759,6 +3445,14 @@ void port_close(struct port *p)
 	unicast_service_cleanup(p);
 	transport_destroy(p->trp);
 	tsproc_destroy(p->tsproc);
+	port_sync_tmpl_flush(p);
+	while (p->rx_cached) {
+		msg_put(p->rx_cache[--p->rx_cached]);
+	}
+	while ((txp = TAILQ_FIRST(&p->txts_pool)) != NULL) {
+		TAILQ_REMOVE(&p->txts_pool, txp, list);
+		free(txp);
+	}
 	if (p->fault_fd >= 0) {
 		close(p->fault_fd);
 	}
@@ -2787,7 +3481,7 @@ struct foreign_clock *port_compute_best(struct port *p)
 
 		fc_prune(fc);
 
-		if (fc->n_messages < FOREIGN_MASTER_THRESHOLD)
+		if (fc->n_messages < fc_threshold(p, fc))
 			continue;
 
 		if (!p->best)
@@ -3011,11 +3705,168 @@ enum fsm_event port_event(struct port *p, int fd_index)
 	return p->event(p, fd_index);
 }
 
-static enum fsm_event bc_event(struct port *p, int fd_index)
+/*
+ * Receives a batch of messages into the cached buffers of the port.
+ * The buffers that are handed out belong to the caller.
+ */
+static int port_recv_batch(struct port *p, int fd, struct ptp_message **msg,
+			   int *cnt)
+{
+	struct ptp_message *m;
+	int i, n;
+
+	while (p->rx_cached < p->rx_batch) {
+		m = msg_allocate_recv();
+		if (!m) {
+			break;
+		}
+		p->rx_cache[p->rx_cached++] = m;
+	}
+	if (!p->rx_cached) {
+		return -ENOMEM;
+	}
+	for (i = 0; i < p->rx_cached; i++) {
+		msg[i] = p->rx_cache[i];
+		msg[i]->hwts.type = p->timestamping;
+	}
+
+	n = transport_recvmany(p->trp, fd, msg, cnt, p->rx_cached);
+	if (n <= 0) {
+		return n;
+	}
+	p->rx_cached -= n;
+	memmove(p->rx_cache, p->rx_cache + n,
+		p->rx_cached * sizeof(p->rx_cache[0]));
+	return n;
+}
+
+static enum fsm_event bc_event_msg(struct port *p, struct ptp_message *msg,
+				   int cnt)
 {
 	enum fsm_event event = EV_NONE;
+	int err;
+
+	if (cnt < 0) {
+		pr_err("%s: recv message failed", p->log_name);
+		msg_put(msg);
+		return EV_FAULT_DETECTED;
+	}
+	err = msg_post_recv(msg, cnt);
+	if (err) {
+		switch (err) {
+		case -EBADMSG:
+			pr_err("%s: bad message", p->log_name);
+			break;
+		case -EPROTO:
+			pr_debug("%s: ignoring message", p->log_name);
+			break;
+		}
+		msg_put(msg);
+		return EV_NONE;
+	}
+	port_stats_inc_rx(p, msg);
+	if (port_ignore(p, msg)) {
+		msg_put(msg);
+		return EV_NONE;
+	}
+	if (msg_sots_missing(msg) &&
+	    !(p->timestamping == TS_P2P1STEP && msg_type(msg) == PDELAY_REQ)) {
+		if (((p->state == PS_MASTER) ||
+		     (p->state == PS_GRAND_MASTER)) &&
+		    (msg_type(msg) == PDELAY_REQ))
+			pr_err("port %hu: received %s without timestamp",
+			       portnum(p), msg_type_string(msg_type(msg)));
+		msg_put(msg);
+		return EV_NONE;
+	}
+	if (msg_sots_valid(msg)) {
+		ts_add(&msg->hwts.ts, -p->rx_timestamp_offset);
+		if (p->state == PS_SLAVE) {
+			clock_check_ts(p->clock,
+				       tmv_to_nanoseconds(msg->hwts.ts));
+		}
+	}
+
+	switch (msg_type(msg)) {
+	case SYNC:
+		process_sync(p, msg);
+		break;
+	case DELAY_REQ:
+		if (process_delay_req(p, msg))
+			event = EV_FAULT_DETECTED;
+		break;
+	case PDELAY_REQ:
+		if (process_pdelay_req(p, msg))
+			event = EV_FAULT_DETECTED;
+		break;
+	case PDELAY_RESP:
+		if (process_pdelay_resp(p, msg))
+			event = EV_FAULT_DETECTED;
+		break;
+	case FOLLOW_UP:
+		process_follow_up(p, msg);
+		break;
+	case DELAY_RESP:
+		process_delay_resp(p, msg);
+		break;
+	case PDELAY_RESP_FOLLOW_UP:
+		process_pdelay_resp_fup(p, msg);
+		break;
+	case ANNOUNCE:
+		if (process_announce(p, msg))
+			event = EV_STATE_DECISION_EVENT;
+		break;
+	case SIGNALING:
+		if (process_signaling(p, msg)) {
+			event = EV_FAULT_DETECTED;
+		}
+		break;
+	case MANAGEMENT:
+		if (clock_manage(p->clock, p, msg))
+			event = EV_STATE_DECISION_EVENT;
+		break;
+	}
+
+	msg_put(msg);
+	return event;
+}
+
+/*
+ * Processes all of the messages received in one pass.  A fault ends
+ * the pass, since the port closes its sockets, otherwise the first
+ * event is reported.  Any state decision event is handled once the
+ * whole batch has been processed, just as for events coming from
+ * several ports in one poll.
+ */
+static enum fsm_event bc_event_batch(struct port *p, int fd)
+{
+	struct ptp_message *msg[TRANSPORT_BATCH_MAX];
+	enum fsm_event ev, event = EV_NONE;
+	int cnt[TRANSPORT_BATCH_MAX];
+	int i, n;
+
+	n = port_recv_batch(p, fd, msg, cnt);
+	if (n < 0) {
+		pr_err("%s: recv message failed", p->log_name);
+		return EV_FAULT_DETECTED;
+	}
+	for (i = 0; i < n; i++) {
+		if (event == EV_FAULT_DETECTED || !port_is_enabled(p)) {
+			msg_put(msg[i]);
+			continue;
+		}
+		ev = bc_event_msg(p, msg[i], cnt[i]);
+		if (ev == EV_FAULT_DETECTED || event == EV_NONE) {
+			event = ev;
+		}
+	}
+	return event;
+}
+
+static enum fsm_event bc_event(struct port *p, int fd_index)
+{
 	struct ptp_message *msg;
-	int cnt, fd = p->fda.fd[fd_index], err;
+	int cnt, fd = p->fda.fd[fd_index];
 
 	switch (fd_index) {
 	case FD_ANNOUNCE_TIMER:
@@ -3110,6 +3961,10 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 		p->service_stats.unicast_request_timeout++;
 		return unicast_client_timer(p) ? EV_FAULT_DETECTED : EV_NONE;
 
+	case FD_TXTS_TIMER:
+		pr_debug("%s: tx timestamp timeout", p->log_name);
+		return port_txts_timeout(p);
+
 	case FD_CMLDS:
 		pr_debug("%s: CMLDS push notification", p->log_name);
 		return process_cmlds(p) ? EV_FAULT_DETECTED : EV_NONE;
@@ -3126,96 +3981,18 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 			return EV_NONE;
 	}
 
-	msg = msg_allocate();
+	if (p->rx_batch > 1) {
+		return bc_event_batch(p, fd);
+	}
+
+	msg = msg_allocate_recv();
 	if (!msg)
 		return EV_FAULT_DETECTED;
 
 	msg->hwts.type = p->timestamping;
 
 	cnt = transport_recv(p->trp, fd, msg);
-	if (cnt < 0) {
-		pr_err("%s: recv message failed", p->log_name);
-		msg_put(msg);
-		return EV_FAULT_DETECTED;
-	}
-	err = msg_post_recv(msg, cnt);
-	if (err) {
-		switch (err) {
-		case -EBADMSG:
-			pr_err("%s: bad message", p->log_name);
-			break;
-		case -EPROTO:
-			pr_debug("%s: ignoring message", p->log_name);
-			break;
-		}
-		msg_put(msg);
-		return EV_NONE;
-	}
-	port_stats_inc_rx(p, msg);
-	if (port_ignore(p, msg)) {
-		msg_put(msg);
-		return EV_NONE;
-	}
-	if (msg_sots_missing(msg) &&
-	    !(p->timestamping == TS_P2P1STEP && msg_type(msg) == PDELAY_REQ)) {
-		if (((p->state == PS_MASTER) ||
-		     (p->state == PS_GRAND_MASTER)) &&
-		    (msg_type(msg) == PDELAY_REQ))
-			pr_err("port %hu: received %s without timestamp",
-			       portnum(p), msg_type_string(msg_type(msg)));
-		msg_put(msg);
-		return EV_NONE;
-	}
-	if (msg_sots_valid(msg)) {
-		ts_add(&msg->hwts.ts, -p->rx_timestamp_offset);
-		if (p->state == PS_SLAVE) {
-			clock_check_ts(p->clock,
-				       tmv_to_nanoseconds(msg->hwts.ts));
-		}
-	}
-
-	switch (msg_type(msg)) {
-	case SYNC:
-		process_sync(p, msg);
-		break;
-	case DELAY_REQ:
-		if (process_delay_req(p, msg))
-			event = EV_FAULT_DETECTED;
-		break;
-	case PDELAY_REQ:
-		if (process_pdelay_req(p, msg))
-			event = EV_FAULT_DETECTED;
-		break;
-	case PDELAY_RESP:
-		if (process_pdelay_resp(p, msg))
-			event = EV_FAULT_DETECTED;
-		break;
-	case FOLLOW_UP:
-		process_follow_up(p, msg);
-		break;
-	case DELAY_RESP:
-		process_delay_resp(p, msg);
-		break;
-	case PDELAY_RESP_FOLLOW_UP:
-		process_pdelay_resp_fup(p, msg);
-		break;
-	case ANNOUNCE:
-		if (process_announce(p, msg))
-			event = EV_STATE_DECISION_EVENT;
-		break;
-	case SIGNALING:
-		if (process_signaling(p, msg)) {
-			event = EV_FAULT_DETECTED;
-		}
-		break;
-	case MANAGEMENT:
-		if (clock_manage(p->clock, p, msg))
-			event = EV_STATE_DECISION_EVENT;
-		break;
-	}
-
-	msg_put(msg);
-	return event;
+	return bc_event_msg(p, msg, cnt);
 }
 
 int port_forward(struct port *p, struct ptp_message *msg)
@@ -3242,14 +4019,11 @@ int port_forward_to(struct port *p, struct ptp_message *msg)
 	return 0;
 }
 
-int port_prepare_and_send(struct port *p, struct ptp_message *msg,
-			  enum transport_event event)
+static int port_send(struct port *p, struct ptp_message *msg,
+		     enum transport_event event)
 {
 	int cnt;
 
-	if (msg_pre_send(msg)) {
-		return -1;
-	}
 	if (msg_unicast(msg)) {
 		cnt = transport_sendto(p->trp, &p->fda, event, msg);
 	} else {
@@ -3265,6 +4039,15 @@ int port_prepare_and_send(struct port *p, struct ptp_message *msg,
 	return 0;
 }
 
+int port_prepare_and_send(struct port *p, struct ptp_message *msg,
+			  enum transport_event event)
+{
+	if (msg_pre_send(msg)) {
+		return -1;
+	}
+	return port_send(p, msg, event);
+}
+
 struct PortIdentity port_identity(struct port *p)
 {
 	return p->portIdentity;
@@ -3476,6 +4259,8 @@ struct port *port_open(const char *phc_device,
 
 	memset(p, 0, sizeof(*p));
 	TAILQ_INIT(&p->tc_transmitted);
+	TAILQ_INIT(&p->txts_pending);
+	TAILQ_INIT(&p->txts_pool);
 
 	p->name = interface_name(interface);
 	if (asprintf(&p->log_name, "port %d (%s)", number, p->name) == -1) {
@@ -3562,9 +4347,12 @@ struct port *port_open(const char *phc_device,
 	p->follow_up_info = config_get_int(cfg, p->name, "follow_up_info");
 	p->freq_est_interval = config_get_int(cfg, p->name, "freq_est_interval");
 	p->msg_interval_request = config_get_int(cfg, p->name, "msg_interval_request");
+	p->fast_acquisition = config_get_int(cfg, p->name, "fast_acquisition");
 	p->net_sync_monitor = config_get_int(cfg, p->name, "net_sync_monitor");
 	p->path_trace_enabled = config_get_int(cfg, p->name, "path_trace_enabled");
 	p->tc_spanning_tree = config_get_int(cfg, p->name, "tc_spanning_tree");
+	p->tx_async = !port_is_uds(p) &&
+		config_get_int(cfg, NULL, "tx_timestamp_async");
 	p->rx_timestamp_offset = config_get_int(cfg, p->name, "ingressLatency");
 	p->rx_timestamp_offset <<= 16;
 	p->tx_timestamp_offset = config_get_int(cfg, p->name, "egressLatency");
@@ -3633,7 +4421,8 @@ struct port *port_open(const char *phc_device,
 
 	p->tsproc = tsproc_create(config_get_int(cfg, p->name, "tsproc_mode"),
 				  config_get_int(cfg, p->name, "delay_filter"),
-				  config_get_int(cfg, p->name, "delay_filter_length"));
+				  config_get_int(cfg, p->name, "delay_filter_length"),
+				  config_get_int(cfg, p->name, "delay_filter_percentile"));
 	if (!p->tsproc) {
 		pr_err("Failed to create time stamp processor");
 		goto err_uc_service;
@@ -3676,6 +4465,33 @@ enum delay_mechanism port_delay_mechanism(struct port *port)
 	return port->delayMechanism;
 }
 
+tmv_t port_peer_mean_delay(struct port *p)
+{
+	return p->peer_delay;
+}
+
+void port_warm_start(struct port *p, struct PortIdentity *parent,
+		     tmv_t peer_delay, int max_age)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	p->warm_parent = *parent;
+	p->warm_parent_valid = 1;
+	p->warm_until = now.tv_sec + max_age;
+	if (tmv_is_zero(peer_delay) || p->delayMechanism != DM_P2P) {
+		return;
+	}
+	p->peer_delay = peer_delay;
+	p->peerMeanPathDelay = tmv_to_TimeInterval(peer_delay);
+	tsproc_set_delay(p->tsproc, peer_delay);
+}
+
+void port_warm_end(struct port *p)
+{
+	p->warm_parent_valid = 0;
+}
+
 int port_state_update(struct port *p, enum fsm_event event, int mdiff)
 {
 	enum port_state next = p->state_machine(p->state, event, mdiff);
@@ -3722,6 +4538,11 @@ int port_state_update(struct port *p, enum fsm_event event, int mdiff)
 		}
 		port_show_transition(p, next, event);
 		p->state = next;
+		if (next == PS_UNCALIBRATED) {
+			port_fast_acquisition_start(p);
+		} else if (next != PS_SLAVE) {
+			port_fast_acquisition_stop(p);
+		}
 		port_notify_event(p, NOTIFY_PORT_STATE);
 		p->unicast_state_dirty = true;
 		return 1;
@@ -87,6 +87,25 @@ void port_dispatch(struct port *p, enum fsm_event event, int mdiff);
  */
 enum fsm_event port_event(struct port *port, int fd_index);
 
+/**
+ * Tests whether a port collects its transmit time stamps
+ * asynchronously, see port_txts_event().
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return     One if time stamps are collected asynchronously, zero otherwise.
+ */
+int port_txts_async(struct port *port);
+
+/**
+ * Collects the transmit time stamps waiting in the error queue of a
+ * port's event socket, and completes the transmissions that were
+ * waiting for them, for example by sending the Follow_Up message.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return One of the @a fsm_event codes.
+ */
+enum fsm_event port_txts_event(struct port *port);
+
 /**
  * Forward a message on a given port.
  * @param port    A pointer previously obtained via port_open().
@@ -236,6 +255,32 @@ enum port_state port_state(struct port *port);
  */
 enum delay_mechanism port_delay_mechanism(struct port *port);
 
+/**
+ * Obtain the filtered peer delay of a port.
+ * @param p        A port instance.
+ * @return         The peer delay, or zero when not measured.
+ */
+tmv_t port_peer_mean_delay(struct port *p);
+
+/**
+ * Seed a port with the state saved before a restart of the program.
+ * The given master qualifies with its first announce message, and the
+ * peer delay is used until the first measurement.
+ * @param p           A port instance.
+ * @param parent      The port identity of the master before the restart.
+ * @param peer_delay  The peer delay before the restart, or zero.
+ * @param max_age     Seconds after which the saved master no longer qualifies.
+ */
+void port_warm_start(struct port *p, struct PortIdentity *parent,
+		     tmv_t peer_delay, int max_age);
+
+/**
+ * End the warm start of a port, so that the saved master qualifies
+ * like any other foreign master.
+ * @param p           A port instance.
+ */
+void port_warm_end(struct port *p);
+
 /**
  * Update a port's current state based on a given event.
  * @param p        A pointer previously obtained via port_open().
@@ -29,6 +29,7 @@
 #include "pmc_common.h"
 #include "power_profile.h"
 #include "tmv.h"
+#include "transport.h"
 #include "util.h"
 
 enum syfu_state {
@@ -60,6 +61,17 @@ struct tc_txd {
 	int ingress_port;
 };
 
+struct txts_pending {
+	TAILQ_ENTRY(txts_pending) list;
+	int (*complete)(struct port *p, struct txts_pending *txp, tmv_t ts);
+	struct ptp_message *msg;
+	struct ptp_message *fup;
+	struct port *ingress;
+	tmv_t ingress_ts;
+	struct timespec sent;
+	uint32_t key;
+};
+
 struct port {
 	LIST_ENTRY(port) list;
 	const char *name;
@@ -86,6 +98,9 @@ struct port {
 	struct ptp_message *peer_delay_fup;
 	int peer_portid_valid;
 	struct PortIdentity peer_portid;
+	int warm_parent_valid;
+	struct PortIdentity warm_parent;
+	time_t warm_until; /* CLOCK_MONOTONIC seconds */
 	struct {
 		UInteger16 announce;
 		UInteger16 delayreq;
@@ -110,6 +125,7 @@ struct port {
 	enum port_state     state; /*portState*/
 	Integer64           asymmetry;
 	enum as_capable     asCapable;
+	Integer8            initialLogMinDelayReqInterval;
 	Integer8            logMinDelayReqInterval;
 	TimeInterval        peerMeanPathDelay;
 	Integer8            initialLogAnnounceInterval;
@@ -127,6 +143,10 @@ struct port {
 	Integer8            operLogPdelayReqInterval;
 	Integer8            logPdelayReqInterval;
 	UInteger32          neighborPropDelayThresh;
+	int                 fast_acquisition;
+	int                 fast_acquiring;
+	Integer8            fastLogSyncInterval;
+	Integer8            fastLogMinDelayReqInterval;
 	int                 follow_up_info;
 	int                 freq_est_interval;
 	int                 hybrid_e2e;
@@ -155,6 +175,17 @@ struct port {
 	LIST_HEAD(fm, foreign_clock) foreign_masters;
 	/* TC book keeping */
 	TAILQ_HEAD(tct, tc_txd) tc_transmitted;
+	/* asynchronous transmit time stamps */
+	int tx_async;
+	/* Sync and Follow_Up in network byte order, see port_sync_msg() */
+	struct ptp_message *sync_tmpl;
+	struct ptp_message *fup_tmpl;
+	TAILQ_HEAD(txts_head, txts_pending) txts_pending;
+	struct txts_head txts_pool;
+	/* batched receive, messages not yet used by port_recv_batch() */
+	int rx_batch;
+	int rx_cached;
+	struct ptp_message *rx_cache[TRANSPORT_BATCH_MAX];
 	/* power profile */
 	struct ieee_c37_238_settings_np pwr;
 	/* unicast client mode */
@@ -199,15 +230,25 @@ int port_set_qualification_tmo(struct port *p);
 int port_set_sync_rx_tmo(struct port *p);
 void port_show_transition(struct port *p, enum port_state next,
 			  enum fsm_event event);
+struct txts_pending *port_txts_park(struct port *p, struct ptp_message *msg,
+				    int (*complete)(struct port *p,
+						    struct txts_pending *txp,
+						    tmv_t ts));
+enum fsm_event port_txts_timeout(struct port *p);
+void port_sync_tmpl_flush(struct port *p);
 struct ptp_message *port_signaling_uc_construct(struct port *p,
 						struct address *address,
 						struct PortIdentity *tpid);
 int port_tx_announce(struct port *p, struct address *dst, uint16_t sequence_id);
+int port_tx_announce_batch(struct port *p, struct address **dst,
+			   uint16_t *sequence_id, int n);
 int port_tx_interval_request(struct port *p,
 			     Integer8 announceInterval,
 			     Integer8 timeSyncInterval,
 			     Integer8 linkDelayInterval);
 int port_tx_sync(struct port *p, struct address *dst, uint16_t sequence_id);
+int port_tx_sync_batch(struct port *p, struct address **dst,
+		       uint16_t *sequence_id, int n);
 int process_announce(struct port *p, struct ptp_message *m);
 void process_delay_resp(struct port *p, struct ptp_message *m);
 void process_follow_up(struct port *p, struct ptp_message *m);
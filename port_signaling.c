@@ -94,6 +94,7 @@ static int process_interval_request(struct port *p,
 	p->logSyncInterval = set_interval(p->logSyncInterval,
 					  r->timeSyncInterval,
 					  p->initialLogSyncInterval);
+	port_sync_tmpl_flush(p);
 
 	p->logPdelayReqInterval = set_interval(p->logPdelayReqInterval,
 					       r->linkDelayInterval,
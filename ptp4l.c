@@ -188,10 +188,17 @@ int main(int argc, char *argv[])
 	print_set_level(config_get_int(cfg, NULL, "logging_level"));
 
 	assume_two_step = config_get_int(cfg, NULL, "assume_two_step");
+	lazy_tlv_parse = config_get_int(cfg, NULL, "lazy_tlv_parse");
 	sk_check_fupsync = config_get_int(cfg, NULL, "check_fup_sync");
 	sk_tx_timeout = config_get_int(cfg, NULL, "tx_timestamp_timeout");
+	sk_tx_async = config_get_int(cfg, NULL, "tx_timestamp_async");
 	sk_hwts_filter_mode = config_get_int(cfg, NULL, "hwts_filter");
 
+	if (msg_pool_init(config_get_int(cfg, NULL, "message_pool_size"))) {
+		fprintf(stderr, "failed to allocate the message pool\n");
+		goto out;
+	}
+
 	ptp_hdr_ver = config_get_int(cfg, NULL, "ptp_minor_version");
 	ptp_hdr_ver = (ptp_hdr_ver << 4) | PTP_MAJOR_VERSION;
 
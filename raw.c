@@ -377,24 +377,18 @@ static int raw_update_rx_filter(struct interface *iface, struct fdarray *fda,
 	return err;
 }
 
-static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
-		    struct address *addr, struct hw_timestamp *hwts)
+static int raw_hlen(struct raw *raw)
 {
-	struct raw *raw = container_of(t, struct raw, t);
-	unsigned char *ptr = buf;
-	struct eth_hdr *hdr;
-	int cnt, hlen;
-
-	if (raw->vlan) {
-		hlen = sizeof(struct vlan_hdr);
-	} else {
-		hlen = sizeof(struct eth_hdr);
-	}
-	ptr    -= hlen;
-	buflen += hlen;
-	hdr = (struct eth_hdr *) ptr;
+	return raw->vlan ? sizeof(struct vlan_hdr) : sizeof(struct eth_hdr);
+}
 
-	cnt = sk_receive(fd, ptr, buflen, addr, hwts, MSG_DONTWAIT);
+/*
+ * Strips the link layer framing from a received frame, whose PTP
+ * payload starts at 'buf' with the Ethernet header in front of it.
+ */
+static int raw_post_recv(struct raw *raw, void *buf, int cnt, int hlen)
+{
+	struct eth_hdr *hdr = (struct eth_hdr *) ((unsigned char *) buf - hlen);
 
 	if (cnt >= 0)
 		cnt -= hlen;
@@ -418,6 +412,51 @@ static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 	return cnt;
 }
 
+static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
+		    struct address *addr, struct hw_timestamp *hwts)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	unsigned char *ptr = buf;
+	int cnt, hlen;
+
+	hlen = raw_hlen(raw);
+	ptr    -= hlen;
+	buflen += hlen;
+
+	cnt = sk_receive(fd, ptr, buflen, addr, hwts, MSG_DONTWAIT);
+
+	return raw_post_recv(raw, buf, cnt, hlen);
+}
+
+static int raw_recvmany(struct transport *t, int fd, struct ptp_message **msg,
+			int *cnt, int n)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	struct hw_timestamp *hwts[TRANSPORT_BATCH_MAX];
+	struct address *addr[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	int i, hlen, res;
+
+	if (n > TRANSPORT_BATCH_MAX)
+		n = TRANSPORT_BATCH_MAX;
+
+	/* The messages have enough head room for the VLAN header. */
+	hlen = raw_hlen(raw);
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = (unsigned char *) msg[i] - hlen;
+		iov[i].iov_len = sizeof(msg[i]->data) + hlen;
+		addr[i] = &msg[i]->address;
+		hwts[i] = &msg[i]->hwts;
+	}
+
+	res = sk_receive_many(fd, iov, addr, hwts, cnt, n);
+
+	for (i = 0; i < res; i++) {
+		cnt[i] = raw_post_recv(raw, msg[i], cnt[i], hlen);
+	}
+	return res;
+}
+
 static int raw_send(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int len,
 		    struct address *addr, struct hw_timestamp *hwts)
@@ -462,6 +501,46 @@ static int raw_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, pkt, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int raw_sendmany(struct transport *t, struct fdarray *fda,
+			enum transport_event event, struct ptp_message **msg,
+			int n)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	struct mmsghdr mmsg[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	struct eth_hdr *hdr;
+	int cnt, fd, i;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	if (n > TRANSPORT_BATCH_MAX)
+		n = TRANSPORT_BATCH_MAX;
+
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+
+	for (i = 0; i < n; i++) {
+		/* The Ethernet header goes into the message's head room. */
+		hdr = (struct eth_hdr *) ((unsigned char *) msg[i] - sizeof(*hdr));
+		addr_to_mac(&hdr->dst, &msg[i]->address);
+		addr_to_mac(&hdr->src, &raw->src_addr);
+		hdr->type = htons(ETH_P_1588);
+
+		iov[i].iov_base = hdr;
+		iov[i].iov_len = ntohs(msg[i]->header.messageLength) +
+			sizeof(*hdr);
+
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	cnt = sendmmsg(fd, mmsg, n, 0);
+	if (cnt < 1) {
+		pr_err("sendmmsg failed: %m");
+		return -errno;
+	}
+	return cnt;
+}
+
 static void raw_release(struct transport *t)
 {
 	struct raw *raw = container_of(t, struct raw, t);
@@ -492,7 +571,9 @@ struct transport *raw_transport_create(void)
 	raw->t.open    = raw_open;
 	raw->t.update_rx_filter = raw_update_rx_filter;
 	raw->t.recv    = raw_recv;
+	raw->t.recvmany = raw_recvmany;
 	raw->t.send    = raw_send;
+	raw->t.sendmany = raw_sendmany;
 	raw->t.release = raw_release;
 	raw->t.physical_addr = raw_physical_addr;
 	raw->t.protocol_addr = raw_protocol_addr;
@@ -16,10 +16,13 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <inttypes.h>
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include "config.h"
+#include "kalman.h"
 #include "linreg.h"
 #include "ntpshm.h"
 #include "nullf.h"
@@ -30,6 +33,33 @@
 
 #include "print.h"
 
+static FILE *servo_trace_open(struct config *cfg)
+{
+	static int count;
+	const char *path;
+	char buf[PATH_MAX];
+	FILE *fp;
+
+	path = config_get_string(cfg, NULL, "servo_trace_file");
+	if (!path || !path[0])
+		return NULL;
+
+	/* Every servo of the process gets its own file. */
+	if (count)
+		snprintf(buf, sizeof(buf), "%s.%d", path, count);
+	else
+		snprintf(buf, sizeof(buf), "%s", path);
+	count++;
+
+	fp = fopen(buf, "w");
+	if (!fp) {
+		pr_err("failed to open servo trace file %s: %m", buf);
+		return NULL;
+	}
+	fprintf(fp, "# local_ts offset weight adj state, or delay raw_delay\n");
+	return fp;
+}
+
 struct servo *servo_create(struct config *cfg, enum servo_type type,
 			   double fadj, int max_ppb, int sw_ts)
 {
@@ -45,6 +75,9 @@ struct servo *servo_create(struct config *cfg, enum servo_type type,
 	case CLOCK_SERVO_LINREG:
 		servo = linreg_servo_create(fadj);
 		break;
+	case CLOCK_SERVO_KALMAN:
+		servo = kalman_servo_create(cfg, fadj, sw_ts);
+		break;
 	case CLOCK_SERVO_NTPSHM:
 		servo = ntpshm_servo_create(cfg);
 		break;
@@ -88,12 +121,16 @@ struct servo *servo_create(struct config *cfg, enum servo_type type,
 	servo->offset_threshold = config_get_int(cfg, NULL, "servo_offset_threshold");
 	servo->num_offset_values = config_get_int(cfg, NULL, "servo_num_offset_values");
 	servo->curr_offset_values = servo->num_offset_values;
+	servo->last_adj = fadj;
+	servo->trace = servo_trace_open(cfg);
 
 	return servo;
 }
 
 void servo_destroy(struct servo *servo)
 {
+	if (servo->trace)
+		fclose(servo->trace);
 	servo->destroy(servo);
 }
 
@@ -122,6 +159,7 @@ double servo_sample(struct servo *servo,
 	double r;
 
 	r = servo->sample(servo, offset, local_ts, weight, state);
+	servo->last_adj = r;
 
 	switch (*state) {
 	case SERVO_UNLOCKED:
@@ -139,26 +177,50 @@ double servo_sample(struct servo *servo,
 		break;
 	case SERVO_LOCKED_STABLE:
 		/*
-		 * This case will never occur since the only place
-		 * SERVO_LOCKED_STABLE is set is in this switch/case block
-		 * (case SERVO_LOCKED).
+		 * Only servos which can tell the stability on their own,
+		 * like the Kalman servo, report this state directly.
 		 */
+		servo->first_update = 0;
 		break;
 	}
 
+	if (servo->trace)
+		fprintf(servo->trace, "%" PRIu64 " %" PRId64 " %.6f %.3f %d\n",
+			local_ts, offset, weight, r, *state);
+
 	return r;
 }
 
+void servo_trace_delay(struct servo *servo, int64_t delay)
+{
+	if (servo->trace)
+		fprintf(servo->trace, "delay %" PRId64 "\n", delay);
+}
+
 void servo_sync_interval(struct servo *servo, double interval)
 {
+	if (servo->trace)
+		fprintf(servo->trace, "interval %.9f\n", interval);
 	servo->sync_interval(servo, interval);
 }
 
 void servo_reset(struct servo *servo)
 {
+	if (servo->trace)
+		fprintf(servo->trace, "reset\n");
 	servo->reset(servo);
 }
 
+void servo_seed(struct servo *servo, double fadj)
+{
+	if (servo->trace)
+		fprintf(servo->trace, "seed %.3f\n", fadj);
+	servo->reset(servo);
+	if (servo->seed)
+		servo->seed(servo, fadj);
+	servo->last_adj = fadj;
+}
+
 double servo_rate_ratio(struct servo *servo)
 {
 	if (servo->rate_ratio)
@@ -167,6 +229,14 @@ double servo_rate_ratio(struct servo *servo)
 	return 1.0;
 }
 
+double servo_frequency(struct servo *servo)
+{
+	if (servo->frequency)
+		return servo->frequency(servo);
+
+	return servo->last_adj;
+}
+
 void servo_leap(struct servo *servo, int leap)
 {
 	if (servo->leap)
@@ -36,6 +36,7 @@ enum servo_type {
 	CLOCK_SERVO_NTPSHM,
 	CLOCK_SERVO_NULLF,
 	CLOCK_SERVO_REFCLOCK_SOCK,
+	CLOCK_SERVO_KALMAN,
 };
 
 /**
@@ -102,6 +103,14 @@ double servo_sample(struct servo *servo,
 		    double weight,
 		    enum servo_state *state);
 
+/**
+ * Record an unfiltered path delay measurement in the servo_trace_file,
+ * so that servo_replay can run it through a delay filter.
+ * @param servo     Pointer to a servo obtained via @ref servo_create().
+ * @param delay     The path delay in nanoseconds.
+ */
+void servo_trace_delay(struct servo *servo, int64_t delay);
+
 /**
  * Inform a clock servo about the master's sync interval.
  * @param servo   Pointer to a servo obtained via @ref servo_create().
@@ -115,6 +124,13 @@ void servo_sync_interval(struct servo *servo, double interval);
  */
 void servo_reset(struct servo *servo);
 
+/**
+ * Reset a clock servo and set its frequency estimate.
+ * @param servo   Pointer to a servo obtained via @ref servo_create().
+ * @param fadj    The frequency in ppb, with the sign of the servo output.
+ */
+void servo_seed(struct servo *servo, double fadj);
+
 /**
  * Obtain ratio between master's frequency and current servo frequency.
  * @param servo   Pointer to a servo obtained via @ref servo_create().
@@ -122,6 +138,15 @@ void servo_reset(struct servo *servo);
  */
 double servo_rate_ratio(struct servo *servo);
 
+/**
+ * Obtain the estimated frequency offset of the clock, without the
+ * correction of the time offset included in the servo output.
+ * @param servo   Pointer to a servo obtained via @ref servo_create().
+ * @return   The frequency in ppb, with the sign of the servo output. The
+ *           last output is returned by servos without an estimate.
+ */
+double servo_frequency(struct servo *servo);
+
 /**
  * Inform a clock servo about upcoming leap second.
  * @param servo   Pointer to a servo obtained via @ref servo_create().
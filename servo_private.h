@@ -20,6 +20,7 @@
 #define HAVE_SERVO_PRIVATE_H
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include "contain.h"
 #include "servo.h"
@@ -32,6 +33,8 @@ struct servo {
 	int64_t offset_threshold;
 	int num_offset_values;
 	int curr_offset_values;
+	double last_adj;
+	FILE *trace;
 
 	void (*destroy)(struct servo *servo);
 
@@ -45,6 +48,10 @@ struct servo {
 
 	double (*rate_ratio)(struct servo *servo);
 
+	double (*frequency)(struct servo *servo);
+
+	void (*seed)(struct servo *servo, double fadj);
+
 	void (*leap)(struct servo *servo, int leap);
 };
 
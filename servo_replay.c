@@ -0,0 +1,444 @@
+/**
+ * @file servo_replay.c
+ * @brief Replays recorded servo samples through a servo and a delay filter.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "filter.h"
+#include "print.h"
+#include "servo.h"
+#include "stats.h"
+#include "tmv.h"
+#include "util.h"
+#include "version.h"
+
+#define DEFAULT_THRESHOLD 100
+
+enum record_type {
+	REC_SAMPLE,
+	REC_DELAY,
+	REC_INTERVAL,
+	REC_RESET,
+	REC_SEED,
+};
+
+struct record {
+	enum record_type type;
+	uint64_t ts;
+	int64_t offset;
+	double weight;
+	int64_t delay;
+	double adj;
+	int state;
+	double interval;
+};
+
+struct replay {
+	struct record *rec;
+	int n_rec;
+	int n_samples;
+	int n_delays;
+	/* Offsets of the recorded and the replayed servo */
+	double *orig;
+	double *offset;
+	uint64_t *ts;
+};
+
+struct result {
+	double conv;
+	int converged;
+	struct stats_result offset;
+};
+
+static int trace_read(struct replay *r, const char *path)
+{
+	struct record rec, *tmp;
+	char line[256];
+	int size = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		pr_err("failed to open %s: %m", path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		memset(&rec, 0, sizeof(rec));
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		} else if (sscanf(line, "interval %lf", &rec.interval) == 1) {
+			rec.type = REC_INTERVAL;
+		} else if (!strncmp(line, "reset", 5)) {
+			rec.type = REC_RESET;
+		} else if (sscanf(line, "seed %lf", &rec.adj) == 1) {
+			rec.type = REC_SEED;
+		} else if (sscanf(line, "delay %" SCNd64, &rec.delay) == 1) {
+			rec.type = REC_DELAY;
+			r->n_delays++;
+		} else if (sscanf(line, "%" SCNu64 " %" SCNd64 " %lf %lf %d",
+				  &rec.ts, &rec.offset, &rec.weight,
+				  &rec.adj, &rec.state) == 5) {
+			rec.type = REC_SAMPLE;
+			r->n_samples++;
+		} else {
+			pr_err("bad line in %s: %s", path, line);
+			fclose(fp);
+			return -1;
+		}
+		if (r->n_rec == size) {
+			size = size ? 2 * size : 1024;
+			tmp = realloc(r->rec, size * sizeof(*r->rec));
+			if (!tmp) {
+				fclose(fp);
+				return -1;
+			}
+			r->rec = tmp;
+		}
+		r->rec[r->n_rec++] = rec;
+	}
+	fclose(fp);
+
+	if (!r->n_samples) {
+		pr_err("no samples in %s", path);
+		return -1;
+	}
+	r->orig = calloc(r->n_samples, sizeof(*r->orig));
+	r->offset = calloc(r->n_samples, sizeof(*r->offset));
+	r->ts = calloc(r->n_samples, sizeof(*r->ts));
+	if (!r->orig || !r->offset || !r->ts) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * The recorded offsets depend on the corrections made by the recorded
+ * servo.  Remove them to get the offsets of the free running clock, and
+ * apply the corrections of the replayed servo instead, like the clock
+ * would see them.  Returns the time spent in the servo.
+ */
+static int64_t replay_servo(struct replay *r, struct servo *servo)
+{
+	double orig_freq = 0.0, orig_corr = 0.0, freq = 0.0, corr = 0.0;
+	uint64_t last_ts = 0;
+	struct timespec t0, t1;
+	enum servo_state state;
+	int64_t offset, ns = 0;
+	struct record *rec;
+	double adj, dt;
+	int i, n = 0;
+
+	for (i = 0; i < r->n_rec; i++) {
+		rec = &r->rec[i];
+		switch (rec->type) {
+		case REC_INTERVAL:
+			servo_sync_interval(servo, rec->interval);
+			continue;
+		case REC_RESET:
+			servo_reset(servo);
+			continue;
+		case REC_SEED:
+			servo_seed(servo, rec->adj);
+			continue;
+		case REC_DELAY:
+			continue;
+		case REC_SAMPLE:
+			break;
+		}
+
+		dt = last_ts ? (int64_t)(rec->ts - last_ts) / 1e9 : 0.0;
+		last_ts = rec->ts;
+		orig_corr += orig_freq * dt;
+		corr += freq * dt;
+
+		offset = llround(rec->offset + orig_corr - corr);
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		adj = servo_sample(servo, offset, rec->ts, rec->weight, &state);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ns += (t1.tv_sec - t0.tv_sec) * NS_PER_SEC +
+			t1.tv_nsec - t0.tv_nsec;
+
+		r->orig[n] = rec->offset;
+		r->offset[n] = offset;
+		r->ts[n] = rec->ts;
+		n++;
+
+		/* The clocks are not adjusted while the servo is unlocked. */
+		if (rec->state != SERVO_UNLOCKED) {
+			orig_freq = rec->adj;
+		}
+		if (rec->state == SERVO_JUMP) {
+			orig_corr += rec->offset;
+		}
+		if (state != SERVO_UNLOCKED) {
+			freq = adj;
+		}
+		if (state == SERVO_JUMP) {
+			corr += offset;
+		}
+	}
+	return ns;
+}
+
+static void evaluate(struct replay *r, double *offset, int threshold,
+		     struct result *res)
+{
+	struct stats *stats;
+	int i, last = -1;
+
+	for (i = 0; i < r->n_samples; i++) {
+		if (fabs(offset[i]) > threshold) {
+			last = i;
+		}
+	}
+	res->converged = last + 1 < r->n_samples;
+	res->conv = 0.0;
+	if (res->converged && last >= 0) {
+		res->conv = (int64_t)(r->ts[last + 1] - r->ts[0]) / 1e9;
+	}
+
+	stats = stats_create();
+	if (!stats) {
+		return;
+	}
+	for (i = res->converged ? last + 1 : 0; i < r->n_samples; i++) {
+		stats_add_value(stats, offset[i]);
+	}
+	stats_get_result(stats, &res->offset);
+	stats_destroy(stats);
+}
+
+static void show_result(const char *name, struct result *res)
+{
+	if (res->converged) {
+		printf("%-9s converged %8.1f s ", name, res->conv);
+	} else {
+		printf("%-9s not converged     ", name);
+	}
+	printf("rms %9.1f max %9.0f\n", res->offset.rms, res->offset.max_abs);
+}
+
+/*
+ * The recorded offsets were computed with the delay estimated on the
+ * clock, so the replayed filter only processes the raw delays and does
+ * not feed back into the replayed offsets.
+ */
+static int64_t replay_filter(struct replay *r, struct filter *filter,
+			     struct stats *stats)
+{
+	struct timespec t0, t1;
+	int64_t ns = 0;
+	tmv_t delay;
+	int i;
+
+	for (i = 0; i < r->n_rec; i++) {
+		if (r->rec[i].type != REC_DELAY) {
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		delay = filter_sample(filter, nanoseconds_to_tmv(r->rec[i].delay));
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ns += (t1.tv_sec - t0.tv_sec) * NS_PER_SEC +
+			t1.tv_nsec - t0.tv_nsec;
+		if (stats) {
+			stats_add_value(stats, tmv_to_nanoseconds(delay));
+		}
+	}
+	return ns;
+}
+
+static int do_replay(struct config *cfg, struct replay *r, int passes,
+		     int threshold, int sw_ts)
+{
+	struct stats_result delay_res;
+	struct result orig, res;
+	struct filter *filter;
+	struct servo *servo;
+	int64_t ns = 0;
+	struct stats *stats;
+	int i;
+
+	for (i = 0; i < passes; i++) {
+		servo = servo_create(cfg, config_get_int(cfg, NULL, "clock_servo"),
+				     0.0, config_get_int(cfg, NULL, "max_frequency"),
+				     sw_ts);
+		if (!servo) {
+			pr_err("failed to create servo");
+			return -1;
+		}
+		ns += replay_servo(r, servo);
+		servo_destroy(servo);
+	}
+	evaluate(r, r->orig, threshold, &orig);
+	evaluate(r, r->offset, threshold, &res);
+
+	printf("samples %d, threshold %d ns\n", r->n_samples, threshold);
+	show_result("recorded", &orig);
+	show_result("replayed", &res);
+	printf("servo     %.1f ns per sample\n",
+	       (double)ns / passes / r->n_samples);
+
+	if (!r->n_delays) {
+		return 0;
+	}
+
+	stats = stats_create();
+	if (!stats) {
+		return -1;
+	}
+	ns = 0;
+	for (i = 0; i < passes; i++) {
+		filter = filter_create(config_get_int(cfg, NULL, "delay_filter"),
+				       config_get_int(cfg, NULL, "delay_filter_length"),
+				       config_get_int(cfg, NULL, "delay_filter_percentile"));
+		if (!filter) {
+			pr_err("failed to create filter");
+			stats_destroy(stats);
+			return -1;
+		}
+		ns += replay_filter(r, filter, i ? NULL : stats);
+		filter_destroy(filter);
+	}
+	printf("delays %d, filtered separately from the replayed offsets\n",
+	       r->n_delays);
+	if (!stats_get_result(stats, &delay_res)) {
+		printf("delay     filtered %9.1f +/- %7.1f min %9.0f max %9.0f\n",
+		       delay_res.mean, delay_res.stddev, delay_res.min,
+		       delay_res.max);
+	}
+	printf("filter    %.1f ns per sample\n",
+	       (double)ns / passes / r->n_delays);
+	stats_destroy(stats);
+
+	return 0;
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\nusage: %s [options] trace\n\n"
+		" -f [file] read configuration from 'file'\n"
+		" -n [num]  number of replay passes for timing, default 1\n"
+		" -s        use the defaults for software time stamping\n"
+		" -t [ns]   offset threshold for convergence, default %d\n"
+		" -h        prints this message and exits\n"
+		" -v        prints the software version and exits\n"
+		"\n"
+		" The servo and the delay filter are selected by the clock_servo\n"
+		" and delay_filter options, for example --clock_servo=linreg.\n"
+		" The filter is run on the recorded raw delays only, the replayed\n"
+		" offsets keep the delay estimated when the trace was recorded.\n"
+		"\n",
+		progname, DEFAULT_THRESHOLD);
+}
+
+int main(int argc, char *argv[])
+{
+	int c, err = -1, index, passes = 1, sw_ts = 0;
+	int threshold = DEFAULT_THRESHOLD;
+	char *config = NULL, *progname;
+	struct replay r = { 0 };
+	struct option *opts;
+	struct config *cfg;
+
+	cfg = config_create();
+	if (!cfg) {
+		return -1;
+	}
+	opts = config_long_options(cfg);
+	print_set_verbose(1);
+	print_set_syslog(0);
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1+progname : argv[0];
+	while (EOF != (c = getopt_long(argc, argv, "f:n:st:hv", opts, &index))) {
+		switch (c) {
+		case 0:
+			if (config_parse_option(cfg, opts[index].name, optarg)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 'f':
+			config = optarg;
+			break;
+		case 'n':
+			if (get_arg_val_i(c, optarg, &passes, 1, INT_MAX)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 's':
+			sw_ts = 1;
+			break;
+		case 't':
+			if (get_arg_val_i(c, optarg, &threshold, 0, INT_MAX)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 'v':
+			version_show(stdout);
+			config_destroy(cfg);
+			return 0;
+		case 'h':
+			usage(progname);
+			config_destroy(cfg);
+			return 0;
+		case '?':
+		default:
+			usage(progname);
+			config_destroy(cfg);
+			return -1;
+		}
+	}
+	if (optind + 1 != argc) {
+		usage(progname);
+		config_destroy(cfg);
+		return -1;
+	}
+
+	if (config && config_read(config, cfg)) {
+		goto out;
+	}
+	/* Don't overwrite the trace being replayed. */
+	config_set_string(cfg, "servo_trace_file", "");
+
+	print_set_progname(progname);
+	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+
+	if (trace_read(&r, argv[optind])) {
+		goto out;
+	}
+	err = do_replay(cfg, &r, passes, threshold, sw_ts);
+out:
+	free(r.rec);
+	free(r.orig);
+	free(r.offset);
+	free(r.ts);
+	config_destroy(cfg);
+	return err;
+}
@@ -19,6 +19,7 @@
  */
 #include <errno.h>
 #include <time.h>
+#include <linux/errqueue.h>
 #include <linux/net_tstamp.h>
 #include <linux/sockios.h>
 #include <linux/ethtool.h>
@@ -40,6 +41,7 @@
 /* globals */
 
 int sk_tx_timeout = 1;
+int sk_tx_async;
 int sk_check_fupsync;
 int sk_tx_type = HWTSTAMP_TX_ON;
 enum hwts_filter_mode sk_hwts_filter_mode = HWTS_FILTER_NORMAL;
@@ -412,18 +414,68 @@ int sk_interface_addr(const char *name, int family, struct address *addr)
 	return result;
 }
 
+static void sk_select_ts(struct hw_timestamp *hwts, struct timespec *ts)
+{
+	switch (hwts->type) {
+	case TS_SOFTWARE:
+		hwts->ts = timespec_to_tmv(ts[0]);
+		break;
+	case TS_HARDWARE:
+	case TS_ONESTEP:
+	case TS_P2P1STEP:
+		hwts->ts = timespec_to_tmv(ts[2]);
+		break;
+	case TS_LEGACY_HW:
+		hwts->ts = timespec_to_tmv(ts[1]);
+		break;
+	}
+}
+
 static short sk_events = POLLPRI;
 static short sk_revents = POLLPRI;
 
+static int sk_receive_cmsg(struct msghdr *msg, struct hw_timestamp *hwts)
+{
+	struct timespec *sw, *ts = NULL;
+	struct cmsghdr *cm;
+	int level, type;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+		level = cm->cmsg_level;
+		type  = cm->cmsg_type;
+		if (SOL_SOCKET == level && SO_TIMESTAMPING == type) {
+			if (cm->cmsg_len < sizeof(*ts) * 3) {
+				pr_warning("short SO_TIMESTAMPING message");
+				return -EMSGSIZE;
+			}
+			ts = (struct timespec *) CMSG_DATA(cm);
+		}
+		if (SOL_SOCKET == level && SO_TIMESTAMPNS == type) {
+			if (cm->cmsg_len < sizeof(*sw)) {
+				pr_warning("short SO_TIMESTAMPNS message");
+				return -EMSGSIZE;
+			}
+			sw = (struct timespec *) CMSG_DATA(cm);
+			hwts->sw = timespec_to_tmv(*sw);
+		}
+	}
+
+	if (!ts) {
+		memset(&hwts->ts, 0, sizeof(hwts->ts));
+		return 0;
+	}
+
+	sk_select_ts(hwts, ts);
+	return 0;
+}
+
 int sk_receive(int fd, void *buf, int buflen,
 	       struct address *addr, struct hw_timestamp *hwts, int flags)
 {
 	char control[256];
-	int cnt = 0, res = 0, level, type;
-	struct cmsghdr *cm;
+	int cnt = 0, err, res = 0;
 	struct iovec iov = { buf, buflen };
 	struct msghdr msg;
-	struct timespec *sw, *ts = NULL;
 
 	memset(control, 0, sizeof(control));
 	memset(&msg, 0, sizeof(msg));
@@ -462,6 +514,77 @@ int sk_receive(int fd, void *buf, int buflen,
 	if (cnt < 0) {
 		pr_err("recvmsg%sfailed: %m",
 		       flags == MSG_ERRQUEUE ? " tx timestamp " : " ");
+		cnt = -errno;
+	}
+	err = sk_receive_cmsg(&msg, hwts);
+	if (err)
+		return err;
+
+	if (addr)
+		addr->len = msg.msg_namelen;
+
+	return cnt;
+}
+
+int sk_receive_many(int fd, struct iovec *iov, struct address **addr,
+		    struct hw_timestamp **hwts, int *cnt, int n)
+{
+	char control[TRANSPORT_BATCH_MAX][256];
+	struct mmsghdr mmsg[TRANSPORT_BATCH_MAX];
+	struct msghdr *msg;
+	int i, res;
+
+	if (n > TRANSPORT_BATCH_MAX)
+		n = TRANSPORT_BATCH_MAX;
+
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+
+	for (i = 0; i < n; i++) {
+		msg = &mmsg[i].msg_hdr;
+		msg->msg_name = &addr[i]->ss;
+		msg->msg_namelen = sizeof(addr[i]->ss);
+		msg->msg_iov = &iov[i];
+		msg->msg_iovlen = 1;
+		msg->msg_control = control[i];
+		msg->msg_controllen = sizeof(control[i]);
+	}
+
+	res = recvmmsg(fd, mmsg, n, MSG_DONTWAIT, NULL);
+	if (res < 0) {
+		pr_err("recvmmsg failed: %m");
+		return -errno;
+	}
+
+	for (i = 0; i < res; i++) {
+		msg = &mmsg[i].msg_hdr;
+		addr[i]->len = msg->msg_namelen;
+		cnt[i] = sk_receive_cmsg(msg, hwts[i]);
+		if (!cnt[i])
+			cnt[i] = mmsg[i].msg_len;
+	}
+	return res;
+}
+
+int sk_receive_txts(int fd, struct hw_timestamp *hwts, uint32_t *key)
+{
+	struct sock_extended_err *err = NULL;
+	struct timespec *ts = NULL;
+	char control[256];
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	int cnt, level, type;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cnt = recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+	if (cnt < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return -EAGAIN;
+		}
+		pr_err("recvmsg tx timestamp failed: %m");
+		return -errno;
 	}
 	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
 		level = cm->cmsg_level;
@@ -473,38 +596,25 @@ int sk_receive(int fd, void *buf, int buflen,
 			}
 			ts = (struct timespec *) CMSG_DATA(cm);
 		}
-		if (SOL_SOCKET == level && SO_TIMESTAMPNS == type) {
-			if (cm->cmsg_len < sizeof(*sw)) {
-				pr_warning("short SO_TIMESTAMPNS message");
-				return -EMSGSIZE;
-			}
-			sw = (struct timespec *) CMSG_DATA(cm);
-			hwts->sw = timespec_to_tmv(*sw);
+		if ((SOL_IP == level && IP_RECVERR == type) ||
+		    (SOL_IPV6 == level && IPV6_RECVERR == type) ||
+		    (SOL_PACKET == level && PACKET_TX_TIMESTAMP == type)) {
+			err = (struct sock_extended_err *) CMSG_DATA(cm);
 		}
 	}
-
-	if (addr)
-		addr->len = msg.msg_namelen;
+	if (!err || err->ee_errno != ENOMSG ||
+	    err->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) {
+		pr_warning("unexpected message on the error queue");
+		return -EPROTO;
+	}
+	*key = err->ee_data;
 
 	if (!ts) {
 		memset(&hwts->ts, 0, sizeof(hwts->ts));
-		return cnt < 0 ? -errno : cnt;
-	}
-
-	switch (hwts->type) {
-	case TS_SOFTWARE:
-		hwts->ts = timespec_to_tmv(ts[0]);
-		break;
-	case TS_HARDWARE:
-	case TS_ONESTEP:
-	case TS_P2P1STEP:
-		hwts->ts = timespec_to_tmv(ts[2]);
-		break;
-	case TS_LEGACY_HW:
-		hwts->ts = timespec_to_tmv(ts[1]);
-		break;
+		return 0;
 	}
-	return cnt < 0 ? -errno : cnt;
+	sk_select_ts(hwts, ts);
+	return 0;
 }
 
 int sk_get_error(int fd)
@@ -679,6 +789,9 @@ int sk_timestamping_init(int fd, const char *device, enum timestamp_type type,
 	if (vclock >= 0)
 		flags |= SOF_TIMESTAMPING_BIND_PHC;
 
+	if (sk_tx_async)
+		flags |= SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
 	timestamping.flags = flags;
 	timestamping.bind_phc = vclock;
 
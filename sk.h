@@ -130,6 +130,34 @@ int sk_interface_addr(const char *name, int family, struct address *addr);
 int sk_receive(int fd, void *buf, int buflen,
 	       struct address *addr, struct hw_timestamp *hwts, int flags);
 
+/**
+ * Read a batch of messages from a socket without blocking, using a
+ * single system call.
+ * @param fd      An open socket.
+ * @param iov     The buffers to receive the messages, one per message.
+ * @param addr    The buffers to receive the source addresses.
+ * @param hwts    The buffers to receive the time stamps.
+ * @param cnt     Returns the length of each message, or a negative
+ *                error code if its control data could not be parsed.
+ * @param n       The number of buffers, at most TRANSPORT_BATCH_MAX.
+ * @return        The number of messages read, or a negative error code.
+ */
+int sk_receive_many(int fd, struct iovec *iov, struct address **addr,
+		    struct hw_timestamp **hwts, int *cnt, int n);
+
+/**
+ * Read one transmit time stamp from a socket's error queue without
+ * blocking.  This is used when the socket was set up with
+ * sk_tx_async, so that the time stamps carry an identifier.
+ * @param fd      An open socket.
+ * @param hwts    Pointer to a buffer to receive the time stamp.
+ * @param key     Returns the SOF_TIMESTAMPING_OPT_ID identifier of
+ *                the packet the time stamp belongs to.
+ * @return        Zero on success, -EAGAIN if the error queue is empty,
+ *                or another negative error code.
+ */
+int sk_receive_txts(int fd, struct hw_timestamp *hwts, uint32_t *key);
+
 /**
  * Get and clear a pending socket error.
  * @param fd      An open socket.
@@ -181,6 +209,13 @@ int sk_timestamping_init(int fd, const char *device, enum timestamp_type type,
  */
 extern int sk_tx_timeout;
 
+/**
+ * Enables the SOF_TIMESTAMPING_OPT_ID option on time stamping sockets,
+ * so that transmit time stamps may be collected from the error queue
+ * asynchronously using sk_receive_txts().
+ */
+extern int sk_tx_async;
+
 /**
  * Enables the SO_TIMESTAMPNS socket option on the both the event and
  * general sockets in order to test the order of paired sync and
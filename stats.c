@@ -22,6 +22,18 @@
 
 #include "stats.h"
 
+/*
+ * The absolute values are counted in a log-linear histogram. Values
+ * below HIST_SUB have a bucket each, every following power of two is
+ * split into HIST_SUB buckets, which bounds the relative error of the
+ * percentiles to 1 / HIST_SUB. Values of 2^HIST_MAX_BITS and more are
+ * counted in the last bucket.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40
+#define HIST_BINS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
 struct stats {
 	unsigned int num;
 	double min;
@@ -29,8 +41,70 @@ struct stats {
 	double mean;
 	double sum_sqr;
 	double sum_diff_sqr;
+	unsigned int hist[HIST_BINS];
 };
 
+static int msb(uint64_t v)
+{
+	return 63 - __builtin_clzll(v);
+}
+
+static int hist_index(double value)
+{
+	uint64_t v;
+	int e;
+
+	value = fabs(value);
+	if (value >= (double)(1ULL << HIST_MAX_BITS))
+		return HIST_BINS - 1;
+	v = llround(value);
+	if (v < HIST_SUB)
+		return v;
+	e = msb(v);
+	if (e >= HIST_MAX_BITS)
+		return HIST_BINS - 1;
+	return (e - HIST_SUB_BITS + 1) * HIST_SUB +
+		(v >> (e - HIST_SUB_BITS)) - HIST_SUB;
+}
+
+static uint64_t hist_lower(int index, uint64_t *width)
+{
+	int e;
+
+	if (index < HIST_SUB) {
+		*width = 1;
+		return index;
+	}
+	e = index / HIST_SUB + HIST_SUB_BITS - 1;
+	*width = 1ULL << (e - HIST_SUB_BITS);
+	return (uint64_t)(HIST_SUB + index % HIST_SUB) << (e - HIST_SUB_BITS);
+}
+
+static double hist_percentile(struct stats *stats, double max_abs, double p)
+{
+	unsigned int rank, cum = 0;
+	uint64_t lower, width;
+	double value;
+	int i;
+
+	rank = ceil(p * stats->num);
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < HIST_BINS; i++) {
+		cum += stats->hist[i];
+		if (cum >= rank)
+			break;
+	}
+	if (i == HIST_BINS)
+		i = HIST_BINS - 1;
+
+	lower = hist_lower(i, &width);
+	value = lower + (width - 1) / 2.0;
+
+	return value < max_abs ? value : max_abs;
+}
+
 struct stats *stats_create(void)
 {
 	struct stats *stats;
@@ -57,6 +131,7 @@ void stats_add_value(struct stats *stats, double value)
 	stats->mean = old_mean + (value - old_mean) / stats->num;
 	stats->sum_sqr += value * value;
 	stats->sum_diff_sqr += (value - old_mean) * (value - stats->mean);
+	stats->hist[hist_index(value)]++;
 }
 
 unsigned int stats_get_num_values(struct stats *stats)
@@ -75,10 +150,33 @@ int stats_get_result(struct stats *stats, struct stats_result *result)
 	result->mean = stats->mean;
 	result->rms = sqrt(stats->sum_sqr / stats->num);
 	result->stddev = sqrt(stats->sum_diff_sqr / stats->num);
+	result->p50 = hist_percentile(stats, result->max_abs, 0.5);
+	result->p99 = hist_percentile(stats, result->max_abs, 0.99);
+	result->p999 = hist_percentile(stats, result->max_abs, 0.999);
 
 	return 0;
 }
 
+unsigned int stats_get_histogram(struct stats *stats, uint32_t *bins,
+				 int n_bins)
+{
+	uint64_t lower, width;
+	int i, bin;
+
+	memset(bins, 0, n_bins * sizeof(*bins));
+
+	for (i = 0; i < HIST_BINS; i++) {
+		if (!stats->hist[i])
+			continue;
+		lower = hist_lower(i, &width);
+		bin = lower ? msb(lower) + 1 : 0;
+		if (bin >= n_bins)
+			bin = n_bins - 1;
+		bins[bin] += stats->hist[i];
+	}
+	return stats->num;
+}
+
 void stats_reset(struct stats *stats)
 {
 	memset(stats, 0, sizeof *stats);
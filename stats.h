@@ -20,6 +20,8 @@
 #ifndef HAVE_STATS_H
 #define HAVE_STATS_H
 
+#include <stdint.h>
+
 /** Opaque type */
 struct stats;
 
@@ -56,6 +58,10 @@ struct stats_result {
 	double mean;
 	double rms;
 	double stddev;
+	/* percentiles of the absolute values */
+	double p50;
+	double p99;
+	double p999;
 };
 
 /**
@@ -66,6 +72,18 @@ struct stats_result {
  */
 int stats_get_result(struct stats *stats, struct stats_result *result);
 
+/**
+ * Obtain the histogram of the absolute values, folded into bins of
+ * powers of two.  Bin 0 counts the values below 1, bin i the values
+ * from 2^(i-1) up to 2^i, and the last bin all values beyond.
+ * @param stats   Pointer to stats obtained via @ref stats_create().
+ * @param bins    Array receiving the counts of the bins.
+ * @param n_bins  The number of elements in the array.
+ * @return        The number of values.
+ */
+unsigned int stats_get_histogram(struct stats *stats, uint32_t *bins,
+				 int n_bins);
+
 /**
  * Reset all statistics.
  * @param stats Pointer to stats obtained via @ref stats_create().
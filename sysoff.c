@@ -18,16 +18,57 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <errno.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include <linux/ptp_clock.h>
 
+#include "contain.h"
 #include "print.h"
 #include "sysoff.h"
 
 #define NS_PER_SEC 1000000000LL
 
+#define TUNER_PROBE_RUNS 16
+#define TUNER_MIN_GAIN 0.9
+
+static const int tuner_samples[] = { 1, 2, 5, 10, PTP_MAX_SAMPLES };
+
+static const char *sysoff_method_names[SYSOFF_LAST] = {
+	[SYSOFF_PRECISE] = "precise",
+	[SYSOFF_EXTENDED] = "extended",
+	[SYSOFF_BASIC] = "basic",
+};
+
+struct sysoff_tuner {
+	int fd;
+	char *name;
+	int method;
+	int n_samples;
+	uint64_t interval;
+	uint64_t next_probe;
+	/* delay of the selected method since the last probe */
+	unsigned int count;
+	double delay_mean;
+	double delay_m2;
+	/* probe in progress, one candidate per measurement */
+	int probing;
+	int probe_busy; /* a candidate is measured outside of the mutex */
+	int probe_method;
+	int probe_index;
+	int best_method;
+	int best_samples;
+	double best_noise;
+	double best_delay;
+	double cur_noise;
+	/* Serializes the measurements of threads sharing the clock. */
+	pthread_mutex_t mutex;
+};
+
 static void print_ioctl_error(const char *name)
 {
 	if (errno == EOPNOTSUPP)
@@ -169,3 +210,236 @@ int sysoff_probe(int fd, int n_samples)
 
 	return SYSOFF_RUN_TIME_MISSING;
 }
+
+const char *sysoff_method_str(int method)
+{
+	if (method < 0 || method >= SYSOFF_LAST)
+		return "none";
+	return sysoff_method_names[method];
+}
+
+static uint64_t tuner_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * Estimates the noise of the offsets measured by a method from a burst
+ * of back to back measurements. The differences of consecutive offsets
+ * are used, so that the drift of the clocks does not count as noise.
+ * Returns a negative value if the method failed.
+ */
+static double tuner_noise(int fd, int method, int n_samples, double *delay)
+{
+	int64_t offset[TUNER_PROBE_RUNS], d;
+	double diff, mean = 0.0, var = 0.0;
+	int i, err, n = 0;
+	uint64_t ts;
+
+	*delay = 0.0;
+	for (i = 0; i < TUNER_PROBE_RUNS; i++) {
+		err = sysoff_measure(fd, method, n_samples,
+				     &offset[n], &ts, &d);
+		if (err == -EBUSY)
+			continue;
+		if (err)
+			return -1.0;
+		*delay += d;
+		n++;
+	}
+	if (n < 3)
+		return -1.0;
+	*delay /= n;
+
+	for (i = 1; i < n; i++)
+		mean += offset[i] - offset[i - 1];
+	mean /= n - 1;
+	for (i = 1; i < n; i++) {
+		diff = offset[i] - offset[i - 1] - mean;
+		var += diff * diff;
+	}
+	var /= n - 2;
+
+	/* The differences carry the noise of two measurements. */
+	return sqrt(var / 2.0);
+}
+
+static void tuner_probe_start(struct sysoff_tuner *t)
+{
+	t->probing = 1;
+	t->probe_method = 0;
+	t->probe_index = 0;
+	t->best_method = -1;
+	t->cur_noise = -1.0;
+}
+
+/*
+ * Records the noise of the current candidate and moves to the next one.
+ * The methods are tried in the order of their cost, and a cheaper
+ * candidate is preferred unless a later one is clearly better. Returns 1
+ * when all candidates are done.
+ */
+static int tuner_probe_update(struct sysoff_tuner *t, double noise,
+			      double delay)
+{
+	int method = t->probe_method, n_samples;
+
+	n_samples = tuner_samples[t->probe_index];
+	if (noise >= 0.0) {
+		pr_debug("%s: sysoff %s/%d delay %.0f noise %.1f",
+			 t->name, sysoff_method_str(method),
+			 n_samples, delay, noise);
+		if (method == t->method && n_samples == t->n_samples)
+			t->cur_noise = noise;
+		if (t->best_method < 0 ||
+		    noise < t->best_noise * TUNER_MIN_GAIN) {
+			t->best_method = method;
+			t->best_samples = n_samples;
+			t->best_noise = noise;
+			t->best_delay = delay;
+		}
+	}
+
+	/* The precise method takes a single sample. */
+	if (noise < 0.0 || method == SYSOFF_PRECISE ||
+	    ++t->probe_index == ARRAY_SIZE(tuner_samples)) {
+		t->probe_method++;
+		t->probe_index = 0;
+	}
+	return t->probe_method == SYSOFF_LAST;
+}
+
+static int tuner_probe_step(struct sysoff_tuner *t)
+{
+	double noise, delay;
+
+	noise = tuner_noise(t->fd, t->probe_method,
+			    tuner_samples[t->probe_index], &delay);
+	return tuner_probe_update(t, noise, delay);
+}
+
+/*
+ * Selects the best candidate of the probe. Switching the method shifts
+ * the measured offsets, so the current selection is kept unless the new
+ * one is clearly better.
+ */
+static void tuner_probe_finish(struct sysoff_tuner *t)
+{
+	t->probing = 0;
+	t->next_probe = tuner_now() + t->interval;
+	t->count = 0;
+	t->delay_mean = 0.0;
+	t->delay_m2 = 0.0;
+	if (t->best_method < 0)
+		return;
+	if (t->cur_noise >= 0.0 &&
+	    t->best_noise >= t->cur_noise * TUNER_MIN_GAIN)
+		return;
+
+	if (t->best_method != t->method || t->best_samples != t->n_samples) {
+		pr_info("%s: selecting sysoff method %s with %d readings, "
+			"delay %.0f noise %.1f", t->name,
+			sysoff_method_str(t->best_method), t->best_samples,
+			t->best_delay, t->best_noise);
+	}
+	t->method = t->best_method;
+	t->n_samples = t->best_samples;
+}
+
+void sysoff_tuner_destroy(struct sysoff_tuner *t)
+{
+	pthread_mutex_destroy(&t->mutex);
+	free(t->name);
+	free(t);
+}
+
+struct sysoff_tuner *sysoff_tuner_create(int fd, const char *name,
+					 int interval)
+{
+	struct sysoff_tuner *t;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+	t->name = strdup(name);
+	if (!t->name) {
+		free(t);
+		return NULL;
+	}
+	t->fd = fd;
+	t->method = SYSOFF_RUN_TIME_MISSING;
+	t->interval = interval * NS_PER_SEC;
+	pthread_mutex_init(&t->mutex, NULL);
+
+	tuner_probe_start(t);
+	while (!tuner_probe_step(t))
+		;
+	tuner_probe_finish(t);
+	if (t->method < 0) {
+		sysoff_tuner_destroy(t);
+		return NULL;
+	}
+	return t;
+}
+
+int sysoff_tuner_measure(struct sysoff_tuner *t, int64_t *result,
+			 uint64_t *ts, int64_t *delay)
+{
+	int err, method, n_samples, probe = 0;
+	double diff, noise, probe_delay;
+
+	pthread_mutex_lock(&t->mutex);
+
+	err = sysoff_measure(t->fd, t->method, t->n_samples,
+			     result, ts, delay);
+	if (!err) {
+		t->count++;
+		diff = *delay - t->delay_mean;
+		t->delay_mean += diff / t->count;
+		t->delay_m2 += diff * (*delay - t->delay_mean);
+	}
+
+	/*
+	 * Probe one candidate after the measurement, so that the probe is
+	 * spread over the updates instead of stalling one of them. The burst
+	 * is taken without the mutex, so that it does not stall the other
+	 * threads sharing the clock either.
+	 */
+	if (!t->probing && tuner_now() >= t->next_probe)
+		tuner_probe_start(t);
+	if (t->probing && !t->probe_busy) {
+		t->probe_busy = 1;
+		method = t->probe_method;
+		n_samples = tuner_samples[t->probe_index];
+		probe = 1;
+	}
+
+	pthread_mutex_unlock(&t->mutex);
+
+	if (!probe)
+		return err;
+
+	noise = tuner_noise(t->fd, method, n_samples, &probe_delay);
+
+	pthread_mutex_lock(&t->mutex);
+	t->probe_busy = 0;
+	if (tuner_probe_update(t, noise, probe_delay))
+		tuner_probe_finish(t);
+	pthread_mutex_unlock(&t->mutex);
+
+	return err;
+}
+
+void sysoff_tuner_get_stats(struct sysoff_tuner *t, struct sysoff_stats *s)
+{
+	pthread_mutex_lock(&t->mutex);
+	s->method = t->method;
+	s->n_samples = t->n_samples;
+	s->delay_mean = t->delay_mean;
+	s->delay_stddev = t->count > 1 ?
+		sqrt(t->delay_m2 / (t->count - 1)) : 0.0;
+	pthread_mutex_unlock(&t->mutex);
+}
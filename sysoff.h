@@ -48,3 +48,61 @@ int sysoff_probe(int fd, int n_samples);
  */
 int sysoff_measure(int fd, int method, int n_samples,
 		   int64_t *result, uint64_t *ts, int64_t *delay);
+
+/**
+ * Obtain the name of a method.
+ * @param method  One of the SYSOFF_ enumeration values.
+ * @return        A string naming the method.
+ */
+const char *sysoff_method_str(int method);
+
+/**
+ * The tuner selects the method and the number of readings which give
+ * the least noisy offsets of a PHC, and repeats the selection
+ * periodically.  It may be shared by several threads.
+ */
+struct sysoff_tuner;
+
+struct sysoff_stats {
+	int method;
+	int n_samples;
+	double delay_mean;
+	double delay_stddev;
+};
+
+/**
+ * Create a tuner for a PHC.  The methods are probed right away.
+ * @param fd        An open file descriptor to a PHC device.
+ * @param name      The name of the clock, used in log messages.
+ * @param interval  The interval between probes in seconds.
+ * @return  A pointer to a new tuner on success, NULL if no method
+ *          is supported or on allocation failure.
+ */
+struct sysoff_tuner *sysoff_tuner_create(int fd, const char *name,
+					 int interval);
+
+/**
+ * Destroy a tuner.
+ * @param t  A tuner obtained via sysoff_tuner_create().
+ */
+void sysoff_tuner_destroy(struct sysoff_tuner *t);
+
+/**
+ * Measure the offset between a PHC and the system time with the
+ * selected method, probing the methods again when due.
+ * @param t       A tuner obtained via sysoff_tuner_create().
+ * @param result  The estimated offset in nanoseconds.
+ * @param ts      The system time corresponding to the 'result'.
+ * @param delay   The delay in reading of the clock in nanoseconds.
+ * @return  Zero on success, negative error code otherwise.
+ */
+int sysoff_tuner_measure(struct sysoff_tuner *t, int64_t *result,
+			 uint64_t *ts, int64_t *delay);
+
+/**
+ * Obtain the selected method and the delay of its measurements since
+ * the last probe.
+ * @param t  A tuner obtained via sysoff_tuner_create().
+ * @param s  Returns the statistics.
+ */
+void sysoff_tuner_get_stats(struct sysoff_tuner *t, struct sysoff_stats *s);
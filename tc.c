@@ -262,12 +262,32 @@ static int tc_current(struct ptp_message *m, struct timespec now)
 	return t2 - t1 < NSEC_PER_SEC;
 }
 
+static tmv_t tc_residence(struct port *q, tmv_t ingress, tmv_t egress)
+{
+	tmv_t residence = tmv_sub(egress, ingress);
+	double rr;
+
+	rr = clock_rate_ratio(q->clock);
+	if (rr != 1.0) {
+		residence = dbl_tmv(tmv_dbl(residence) * rr);
+	}
+	return residence;
+}
+
+static int tc_txts_complete(struct port *p, struct txts_pending *txp, tmv_t ts)
+{
+	tmv_t residence = tc_residence(txp->ingress, txp->ingress_ts, ts);
+
+	tc_complete(txp->ingress, p, txp->msg, residence);
+	return 0;
+}
+
 static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 {
 	tmv_t egress, ingress = msg->hwts.ts, residence;
+	struct txts_pending *txp;
 	struct port *p;
 	int cnt, err;
-	double rr;
 
 	clock_gettime(CLOCK_MONOTONIC, &msg->ts.host);
 
@@ -281,12 +301,26 @@ static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 			pr_err("failed to forward event from %s to %s",
 				q->log_name, p->log_name);
 			port_dispatch(p, EV_FAULT_DETECTED, 0);
+			continue;
+		}
+		if (!p->tx_async) {
+			continue;
 		}
+		/* The residence time is completed when the time stamp arrives. */
+		txp = port_txts_park(p, msg, tc_txts_complete);
+		if (!txp) {
+			pr_err("failed to fetch txts on %s to %s event",
+				q->log_name, p->log_name);
+			port_dispatch(p, EV_FAULT_DETECTED, 0);
+			continue;
+		}
+		txp->ingress = q;
+		txp->ingress_ts = ingress;
 	}
 
 	/* Go back and gather the transmit time stamps. */
 	for (p = clock_first_port(q->clock); p; p = LIST_NEXT(p, list)) {
-		if (tc_blocked(q, p, msg)) {
+		if (p->tx_async || tc_blocked(q, p, msg)) {
 			continue;
 		}
 		err = transport_txts(&p->fda, msg);
@@ -298,11 +332,7 @@ static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 		}
 		ts_add(&msg->hwts.ts, p->tx_timestamp_offset);
 		egress = msg->hwts.ts;
-		residence = tmv_sub(egress, ingress);
-		rr = clock_rate_ratio(q->clock);
-		if (rr != 1.0) {
-			residence = dbl_tmv(tmv_dbl(residence) * rr);
-		}
+		residence = tc_residence(q, ingress, egress);
 		tc_complete(q, p, msg, residence);
 	}
 
@@ -69,6 +69,32 @@ static void timestamp_net2host(struct Timestamp *t)
 	NTOHL(t->nanoseconds);
 }
 
+static void stats_histogram_le2cpu(struct StatsHistogram *h)
+{
+	int i;
+
+	h->count = __le64_to_cpu(h->count);
+	h->p50 = __le64_to_cpu(h->p50);
+	h->p99 = __le64_to_cpu(h->p99);
+	h->p999 = __le64_to_cpu(h->p999);
+	h->max = __le64_to_cpu(h->max);
+	for (i = 0; i < STATS_HISTOGRAM_BINS; i++)
+		h->bins[i] = __le32_to_cpu(h->bins[i]);
+}
+
+static void stats_histogram_cpu2le(struct StatsHistogram *h)
+{
+	int i;
+
+	h->count = __cpu_to_le64(h->count);
+	h->p50 = __cpu_to_le64(h->p50);
+	h->p99 = __cpu_to_le64(h->p99);
+	h->p999 = __cpu_to_le64(h->p999);
+	h->max = __cpu_to_le64(h->max);
+	for (i = 0; i < STATS_HISTOGRAM_BINS; i++)
+		h->bins[i] = __cpu_to_le32(h->bins[i]);
+}
+
 static uint16_t flip16(void *p)
 {
 	uint16_t v;
@@ -169,6 +195,8 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 	struct ieee_c37_238_settings_np *pwr;
 	struct unicast_master_table_np *umtn;
 	struct grandmaster_settings_np *gsn;
+	struct message_pool_stats_np *mpsn;
+	struct clock_stats_np *csn;
 	struct port_service_stats_np *pssn;
 	struct mgmt_clock_description *cd;
 	struct unicast_master_entry *ume;
@@ -376,6 +404,26 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 			ntohs(gsn->clockQuality.offsetScaledLogVariance);
 		gsn->utc_offset = ntohs(gsn->utc_offset);
 		break;
+	case MID_MESSAGE_POOL_STATS_NP:
+		if (data_len != sizeof(struct message_pool_stats_np))
+			goto bad_length;
+		mpsn = (struct message_pool_stats_np *) m->data;
+		mpsn->stats.capacity = __le64_to_cpu(mpsn->stats.capacity);
+		mpsn->stats.allocated = __le64_to_cpu(mpsn->stats.allocated);
+		mpsn->stats.in_use = __le64_to_cpu(mpsn->stats.in_use);
+		mpsn->stats.max_in_use = __le64_to_cpu(mpsn->stats.max_in_use);
+		mpsn->stats.heap_allocations =
+			__le64_to_cpu(mpsn->stats.heap_allocations);
+		mpsn->stats.alloc_failures =
+			__le64_to_cpu(mpsn->stats.alloc_failures);
+		break;
+	case MID_CLOCK_STATS_NP:
+		if (data_len != sizeof(struct clock_stats_np))
+			goto bad_length;
+		csn = (struct clock_stats_np *) m->data;
+		stats_histogram_le2cpu(&csn->offset);
+		stats_histogram_le2cpu(&csn->delay);
+		break;
 	case MID_PORT_DATA_SET_NP:
 		if (data_len != sizeof(struct port_ds_np))
 			goto bad_length;
@@ -517,6 +565,8 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 	struct ieee_c37_238_settings_np *pwr;
 	struct unicast_master_table_np *umtn;
 	struct grandmaster_settings_np *gsn;
+	struct message_pool_stats_np *mpsn;
+	struct clock_stats_np *csn;
 	struct port_service_stats_np *pssn;
 	struct mgmt_clock_description *cd;
 	struct unicast_master_entry *ume;
@@ -603,6 +653,22 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 			htons(gsn->clockQuality.offsetScaledLogVariance);
 		gsn->utc_offset = htons(gsn->utc_offset);
 		break;
+	case MID_MESSAGE_POOL_STATS_NP:
+		mpsn = (struct message_pool_stats_np *) m->data;
+		mpsn->stats.capacity = __cpu_to_le64(mpsn->stats.capacity);
+		mpsn->stats.allocated = __cpu_to_le64(mpsn->stats.allocated);
+		mpsn->stats.in_use = __cpu_to_le64(mpsn->stats.in_use);
+		mpsn->stats.max_in_use = __cpu_to_le64(mpsn->stats.max_in_use);
+		mpsn->stats.heap_allocations =
+			__cpu_to_le64(mpsn->stats.heap_allocations);
+		mpsn->stats.alloc_failures =
+			__cpu_to_le64(mpsn->stats.alloc_failures);
+		break;
+	case MID_CLOCK_STATS_NP:
+		csn = (struct clock_stats_np *) m->data;
+		stats_histogram_cpu2le(&csn->offset);
+		stats_histogram_cpu2le(&csn->delay);
+		break;
 	case MID_PORT_DATA_SET_NP:
 		pdsnp = (struct port_ds_np *) m->data;
 		pdsnp->neighborPropDelayThresh = htonl(pdsnp->neighborPropDelayThresh);
@@ -100,6 +100,8 @@ enum management_action {
 #define MID_GRANDMASTER_SETTINGS_NP			0xC001
 #define MID_SUBSCRIBE_EVENTS_NP				0xC003
 #define MID_SYNCHRONIZATION_UNCERTAIN_NP		0xC006
+#define MID_MESSAGE_POOL_STATS_NP			0xC00C
+#define MID_CLOCK_STATS_NP				0xC00D
 
 /* Port management ID values */
 #define MID_NULL_MANAGEMENT				0x0000
@@ -438,6 +440,15 @@ struct port_service_stats_np {
 	struct PortServiceStats stats;
 } PACKED;
 
+struct message_pool_stats_np {
+	struct MessagePoolStats stats;
+} PACKED;
+
+struct clock_stats_np {
+	struct StatsHistogram offset;
+	struct StatsHistogram delay;
+} PACKED;
+
 struct unicast_master_table_np {
 	uint16_t actual_table_size;
 	struct unicast_master_entry unicast_masters[0];
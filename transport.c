@@ -34,6 +34,7 @@ int transport_close(struct transport *t, struct fdarray *fda)
 int transport_open(struct transport *t, struct interface *iface,
 		   struct fdarray *fda, enum timestamp_type tt)
 {
+	t->txts_key = 0;
 	return t->open(t, iface, fda, tt);
 }
 
@@ -49,28 +50,82 @@ int transport_recv(struct transport *t, int fd, struct ptp_message *msg)
 	return t->recv(t, fd, msg, sizeof(msg->data), &msg->address, &msg->hwts);
 }
 
+/*
+ * Every packet sent on the event socket consumes one identifier from
+ * the kernel's SOF_TIMESTAMPING_OPT_ID counter.  Keep a shadow copy,
+ * so that asynchronously collected time stamps can be matched to the
+ * messages that produced them.
+ */
+static int transport_count(struct transport *t, enum transport_event event,
+			   struct ptp_message *msg, int cnt)
+{
+	if (cnt > 0 && event != TRANS_GENERAL) {
+		msg->hwts.key = t->txts_key++;
+	}
+	return cnt;
+}
+
 int transport_send(struct transport *t, struct fdarray *fda,
 		   enum transport_event event, struct ptp_message *msg)
 {
-	int len = ntohs(msg->header.messageLength);
+	int cnt, len = ntohs(msg->header.messageLength);
 
-	return t->send(t, fda, event, 0, msg, len, NULL, &msg->hwts);
+	cnt = t->send(t, fda, event, 0, msg, len, NULL, &msg->hwts);
+	return transport_count(t, event, msg, cnt);
 }
 
 int transport_peer(struct transport *t, struct fdarray *fda,
 		   enum transport_event event, struct ptp_message *msg)
 {
-	int len = ntohs(msg->header.messageLength);
+	int cnt, len = ntohs(msg->header.messageLength);
 
-	return t->send(t, fda, event, 1, msg, len, NULL, &msg->hwts);
+	cnt = t->send(t, fda, event, 1, msg, len, NULL, &msg->hwts);
+	return transport_count(t, event, msg, cnt);
 }
 
 int transport_sendto(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, struct ptp_message *msg)
 {
-	int len = ntohs(msg->header.messageLength);
+	int cnt, len = ntohs(msg->header.messageLength);
+
+	cnt = t->send(t, fda, event, 0, msg, len, &msg->address, &msg->hwts);
+	return transport_count(t, event, msg, cnt);
+}
+
+int transport_sendmany(struct transport *t, struct fdarray *fda,
+		       enum transport_event event, struct ptp_message **msg,
+		       int n)
+{
+	int cnt, i, sent;
+
+	if (!t->sendmany || event == TRANS_EVENT) {
+		for (i = 0; i < n; i++) {
+			if (transport_sendto(t, fda, event, msg[i]) <= 0) {
+				return i ? i : -1;
+			}
+		}
+		return n;
+	}
+	for (sent = 0; sent < n; sent += cnt) {
+		cnt = t->sendmany(t, fda, event, msg + sent, n - sent);
+		if (cnt <= 0) {
+			return sent ? sent : cnt;
+		}
+		for (i = sent; i < sent + cnt; i++) {
+			transport_count(t, event, msg[i], 1);
+		}
+	}
+	return n;
+}
 
-	return t->send(t, fda, event, 0, msg, len, &msg->address, &msg->hwts);
+int transport_recvmany(struct transport *t, int fd, struct ptp_message **msg,
+		       int *cnt, int n)
+{
+	if (!t->recvmany || n == 1) {
+		cnt[0] = transport_recv(t, fd, msg[0]);
+		return cnt[0] < 0 ? cnt[0] : 1;
+	}
+	return t->recvmany(t, fd, msg, cnt, n);
 }
 
 int transport_txts(struct fdarray *fda,
@@ -84,6 +139,12 @@ int transport_txts(struct fdarray *fda,
 	return cnt > 0 ? 0 : cnt;
 }
 
+int transport_txts_async(struct fdarray *fda, struct hw_timestamp *hwts,
+			 uint32_t *key)
+{
+	return sk_receive_txts(fda->fd[FD_EVENT], hwts, key);
+}
+
 int transport_physical_addr(struct transport *t, uint8_t *addr)
 {
 	if (t->physical_addr) {
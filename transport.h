@@ -106,6 +106,41 @@ int transport_peer(struct transport *t, struct fdarray *fda,
 int transport_sendto(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, struct ptp_message *msg);
 
+#define TRANSPORT_BATCH_MAX 64
+
+/**
+ * Sends a number of PTP messages using the given transport, with a
+ * single system call when the transport supports it. The addresses
+ * have to be provided in the address fields of the messages. Since
+ * there is no way to wait for the individual time stamps, a batch of
+ * TRANS_EVENT messages is sent one message at a time.
+ * @param t	The transport.
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param event	One of the @ref transport_event enumeration values.
+ * @param msg	The messages to send.
+ * @param n	The number of messages, at most TRANSPORT_BATCH_MAX.
+ * @return	Number of messages sent, or negative value in case of an
+ *		error.
+ */
+int transport_sendmany(struct transport *t, struct fdarray *fda,
+		       enum transport_event event, struct ptp_message **msg,
+		       int n);
+
+/**
+ * Receives the PTP messages waiting on a socket without blocking,
+ * with a single system call when the transport supports it.
+ * Otherwise exactly one message is received, as by transport_recv().
+ * @param t	The transport.
+ * @param fd	The socket to read, FD_EVENT or FD_GENERAL.
+ * @param msg	The messages to fill in. The time stamp type must be set.
+ * @param cnt	Returns the result of transport_recv() for each message.
+ * @param n	The number of messages, at most TRANSPORT_BATCH_MAX.
+ * @return	Number of messages received, or negative value in case
+ *		of an error.
+ */
+int transport_recvmany(struct transport *t, int fd, struct ptp_message **msg,
+		       int *cnt, int n);
+
 /**
  * Fetches the transmit time stamp for a PTP message that was sent
  * with the TRANS_DEFER_EVENT flag.
@@ -118,6 +153,20 @@ int transport_sendto(struct transport *t, struct fdarray *fda,
 int transport_txts(struct fdarray *fda,
 		   struct ptp_message *msg);
 
+/**
+ * Fetches the next transmit time stamp waiting on the event socket
+ * without blocking.  Used when the time stamps of messages sent with
+ * the TRANS_DEFER_EVENT flag are collected asynchronously.
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param hwts	Returns the time stamp.  The type field must be set.
+ * @param key	Returns the key of the message, matching the value of
+ *		msg->hwts.key after the message was sent.
+ * @return	Zero on success, -EAGAIN if no time stamp is pending,
+ *		or another negative value in case of an error.
+ */
+int transport_txts_async(struct fdarray *fda, struct hw_timestamp *hwts,
+			 uint32_t *key);
+
 /**
  * Returns the transport's type.
  */
@@ -29,6 +29,7 @@
 struct transport {
 	enum transport_type type;
 	struct config *cfg;
+	uint32_t txts_key;
 
 	int (*close)(struct transport *t, struct fdarray *fda);
 
@@ -41,10 +42,17 @@ struct transport {
 	int (*recv)(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	int (*recvmany)(struct transport *t, int fd, struct ptp_message **msg,
+			int *cnt, int n);
+
 	int (*send)(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	int (*sendmany)(struct transport *t, struct fdarray *fda,
+			enum transport_event event, struct ptp_message **msg,
+			int n);
+
 	void (*release)(struct transport *t);
 
 	int (*physical_addr)(struct transport *t, uint8_t *addr);
@@ -24,6 +24,15 @@
 #include "filter.h"
 #include "print.h"
 
+struct tsproc_sample {
+	tmv_t offset;
+	tmv_t transit;
+	tmv_t ts;
+	double weight;
+	/* transit time relative to the trend of the window, ns */
+	double residual;
+};
+
 struct tsproc {
 	/* Processing options */
 	enum tsproc_mode mode;
@@ -43,8 +52,20 @@ struct tsproc {
 	tmv_t filtered_delay;
 	int filtered_delay_valid;
 
+	/* Unfiltered delay of the latest measurement */
+	tmv_t raw_delay;
+
 	/* Delay filter */
 	struct filter *delay_filter;
+
+	/* Packet selection window */
+	struct tsproc_sample *select;
+	int select_length;
+	int select_count;
+	int select_cnt;
+
+	/* Local time of the last offset */
+	tmv_t offset_ts;
 };
 
 static int weighting(struct tsproc *tsp)
@@ -61,7 +82,8 @@ static int weighting(struct tsproc *tsp)
 }
 
 struct tsproc *tsproc_create(enum tsproc_mode mode,
-			     enum filter_type delay_filter, int filter_length)
+			     enum filter_type delay_filter, int filter_length,
+			     int percentile)
 {
 	struct tsproc *tsp;
 
@@ -81,7 +103,8 @@ struct tsproc *tsproc_create(enum tsproc_mode mode,
 		return NULL;
 	}
 
-	tsp->delay_filter = filter_create(delay_filter, filter_length);
+	tsp->delay_filter = filter_create(delay_filter, filter_length,
+					  percentile);
 	if (!tsp->delay_filter) {
 		free(tsp);
 		return NULL;
@@ -92,8 +115,26 @@ struct tsproc *tsproc_create(enum tsproc_mode mode,
 	return tsp;
 }
 
+int tsproc_set_selection(struct tsproc *tsp, int length, int count)
+{
+	struct tsproc_sample *select = NULL;
+
+	if (length > 1) {
+		select = calloc(length, sizeof(*select));
+		if (!select)
+			return -1;
+	}
+	free(tsp->select);
+	tsp->select = select;
+	tsp->select_length = select ? length : 0;
+	tsp->select_count = count < 1 ? 1 : count > length ? length : count;
+	tsp->select_cnt = 0;
+	return 0;
+}
+
 void tsproc_destroy(struct tsproc *tsp)
 {
+	free(tsp->select);
 	filter_destroy(tsp->delay_filter);
 	free(tsp);
 }
@@ -153,6 +194,7 @@ int tsproc_update_delay(struct tsproc *tsp, tmv_t *delay)
 		return -1;
 
 	raw_delay = get_raw_delay(tsp);
+	tsp->raw_delay = raw_delay;
 	tsp->filtered_delay = filter_sample(tsp->delay_filter, raw_delay);
 	tsp->filtered_delay_valid = 1;
 
@@ -178,8 +220,103 @@ int tsproc_update_delay(struct tsproc *tsp, tmv_t *delay)
 	return 0;
 }
 
+static int sample_cmp(const void *a, const void *b)
+{
+	const struct tsproc_sample *sa = a, *sb = b;
+
+	if (sa->residual < sb->residual)
+		return -1;
+	return sa->residual > sb->residual ? 1 : 0;
+}
+
+/*
+ * The transit times drift with the offset while the frequency is not
+ * yet corrected, e.g. by 1.6 ms over 16 s at 100 ppm.  Rank the samples
+ * by their residual to a line fitted over the window, so that they are
+ * selected by their queuing delay and not by their position in time.
+ */
+static void select_detrend(struct tsproc *tsp)
+{
+	double x, y, xm = 0.0, ym = 0.0, sxx = 0.0, sxy = 0.0, slope = 0.0;
+	struct tsproc_sample *s = tsp->select;
+	int i, n = tsp->select_length;
+
+	for (i = 0; i < n; i++) {
+		xm += tmv_dbl(tmv_sub(s[i].ts, s[0].ts));
+		ym += tmv_dbl(tmv_sub(s[i].transit, s[0].transit));
+	}
+	xm /= n;
+	ym /= n;
+	/* Two points always lie on a line, keep their plain transit times. */
+	if (n > 2) {
+		for (i = 0; i < n; i++) {
+			x = tmv_dbl(tmv_sub(s[i].ts, s[0].ts)) - xm;
+			y = tmv_dbl(tmv_sub(s[i].transit, s[0].transit)) - ym;
+			sxx += x * x;
+			sxy += x * y;
+		}
+		if (sxx > 0.0)
+			slope = sxy / sxx;
+	}
+	for (i = 0; i < n; i++) {
+		x = tmv_dbl(tmv_sub(s[i].ts, s[0].ts)) - xm;
+		y = tmv_dbl(tmv_sub(s[i].transit, s[0].transit)) - ym;
+		s[i].residual = y - slope * x;
+	}
+}
+
+/*
+ * Collect the offsets over the selection window and combine those with
+ * the shortest detrended transit time from the master, which suffered
+ * the least queuing delay.  As the delay is the same for all the samples
+ * in the window, it doesn't need to be known for the selection.
+ */
+static int select_offset(struct tsproc *tsp, tmv_t *offset, double *weight)
+{
+	struct tsproc_sample *s = &tsp->select[tsp->select_cnt];
+	tmv_t sum_offset, sum_ts;
+	double sum_weight;
+	int i, n;
+
+	s->offset = *offset;
+	s->transit = tmv_sub(tsp->t2, tsp->t1);
+	s->ts = tsp->t2;
+	s->weight = *weight;
+
+	if (++tsp->select_cnt < tsp->select_length)
+		return 1;
+	tsp->select_cnt = 0;
+
+	select_detrend(tsp);
+	qsort(tsp->select, tsp->select_length, sizeof(*tsp->select),
+	      sample_cmp);
+
+	/* Sum the times relative to the first sample to avoid overflow. */
+	n = tsp->select_count;
+	sum_offset = tmv_zero();
+	sum_ts = tmv_zero();
+	sum_weight = 0.0;
+	for (i = 0; i < n; i++) {
+		sum_offset = tmv_add(sum_offset, tsp->select[i].offset);
+		sum_ts = tmv_add(sum_ts, tmv_sub(tsp->select[i].ts,
+						 tsp->select[0].ts));
+		sum_weight += tsp->select[i].weight;
+	}
+	*offset = tmv_div(sum_offset, n);
+	*weight = sum_weight / n;
+	tsp->offset_ts = tmv_add(tsp->select[0].ts, tmv_div(sum_ts, n));
+
+	pr_debug("selected %d of %d offsets, transit residual %.0f to %.0f",
+		 n, tsp->select_length, tsp->select[0].residual,
+		 tsp->select[n - 1].residual);
+
+	return 0;
+}
+
 int tsproc_update_offset(struct tsproc *tsp, tmv_t *offset, double *weight)
 {
+	double w;
+
 	tmv_t delay = tmv_zero(), raw_delay = tmv_zero();
 
 	if (tmv_is_zero(tsp->t1) || tmv_is_zero(tsp->t2))
@@ -211,28 +348,43 @@ int tsproc_update_offset(struct tsproc *tsp, tmv_t *offset, double *weight)
 
 	/* offset = t2 - t1 - delay */
 	*offset = tmv_sub(tmv_sub(tsp->t2, tsp->t1), delay);
-
-	if (!weight)
-		return 0;
+	tsp->offset_ts = tsp->t2;
 
 	if (weighting(tsp) && tmv_sign(tsp->filtered_delay) > 0 &&
 	    tmv_sign(raw_delay) > 0) {
-		*weight = tmv_dbl(tsp->filtered_delay) / tmv_dbl(raw_delay);
-		if (*weight > 1.0)
-			*weight = 1.0;
+		w = tmv_dbl(tsp->filtered_delay) / tmv_dbl(raw_delay);
+		if (w > 1.0)
+			w = 1.0;
 	} else {
-		*weight = 1.0;
+		w = 1.0;
 	}
 
+	if (tsp->select && select_offset(tsp, offset, &w))
+		return 1;
+
+	if (weight)
+		*weight = w;
+
 	return 0;
 }
 
+tmv_t tsproc_offset_ts(struct tsproc *tsp)
+{
+	return tsp->offset_ts;
+}
+
+tmv_t tsproc_raw_delay(struct tsproc *tsp)
+{
+	return tsp->raw_delay;
+}
+
 void tsproc_reset(struct tsproc *tsp, int full)
 {
 	tsp->t1 = tmv_zero();
 	tsp->t2 = tmv_zero();
 	tsp->t3 = tmv_zero();
 	tsp->t4 = tmv_zero();
+	tsp->select_cnt = 0;
 
 	if (full) {
 		tsp->clock_rate_ratio = 1.0;
@@ -40,10 +40,23 @@ enum tsproc_mode {
  * @param mode           Time stamp processing mode.
  * @param delay_filter   Type of the filter that will be applied to delay.
  * @param filter_length  Length of the filter.
+ * @param percentile     Percentile of the moving_percentile filter.
  * @return               A pointer to a new tsproc on success, NULL otherwise.
  */
 struct tsproc *tsproc_create(enum tsproc_mode mode,
-			     enum filter_type delay_filter, int filter_length);
+			     enum filter_type delay_filter, int filter_length,
+			     int percentile);
+
+/**
+ * Enable packet selection, where the offsets are collected over a window
+ * and only the average of those with the shortest transit time from the
+ * remote clock is reported, once per window.
+ * @param tsp     Pointer obtained via @ref tsproc_create().
+ * @param length  Number of offsets in the window, 0 or 1 to disable.
+ * @param count   Number of offsets to be averaged.
+ * @return        0 on success, -1 on allocation failure.
+ */
+int tsproc_set_selection(struct tsproc *tsp, int length, int count);
 
 /**
  * Destroy a time stamp processor.
@@ -95,10 +108,26 @@ int tsproc_update_delay(struct tsproc *tsp, tmv_t *delay);
  * @param tsp    Pointer obtained via @ref tsproc_create().
  * @param offset A pointer to store the new offset.
  * @param weight A pointer to store the weight of the sample, may be NULL.
- * @return       0 on success, -1 when missing a measurement.
+ * @return       0 on success, -1 when missing a measurement, 1 while the
+ *               packet selection window is being filled.
  */
 int tsproc_update_offset(struct tsproc *tsp, tmv_t *offset, double *weight);
 
+/**
+ * Get the local time corresponding to the last offset.
+ * @param tsp    Pointer obtained via @ref tsproc_create().
+ * @return       The time of the latest downstream measurement, or the
+ *               average time of the selected measurements.
+ */
+tmv_t tsproc_offset_ts(struct tsproc *tsp);
+
+/**
+ * Get the unfiltered delay of the last delay measurement.
+ * @param tsp    Pointer obtained via @ref tsproc_create().
+ * @return       The delay before the delay filter.
+ */
+tmv_t tsproc_raw_delay(struct tsproc *tsp);
+
 /**
  * Reset a time stamp processor.
  * @param tsp    Pointer obtained via @ref tsproc_create().
@@ -229,6 +229,26 @@ static int udp_recv(struct transport *t, int fd, void *buf, int buflen,
 	return sk_receive(fd, buf, buflen, addr, hwts, MSG_DONTWAIT);
 }
 
+static int udp_recvmany(struct transport *t, int fd, struct ptp_message **msg,
+			int *cnt, int n)
+{
+	struct hw_timestamp *hwts[TRANSPORT_BATCH_MAX];
+	struct address *addr[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	int i;
+
+	if (n > TRANSPORT_BATCH_MAX)
+		n = TRANSPORT_BATCH_MAX;
+
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = msg[i];
+		iov[i].iov_len = sizeof(msg[i]->data);
+		addr[i] = &msg[i]->address;
+		hwts[i] = &msg[i]->hwts;
+	}
+	return sk_receive_many(fd, iov, addr, hwts, cnt, n);
+}
+
 static int udp_send(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int len,
 		    struct address *addr, struct hw_timestamp *hwts)
@@ -280,6 +300,46 @@ static int udp_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int udp_sendmany(struct transport *t, struct fdarray *fda,
+			enum transport_event event, struct ptp_message **msg,
+			int n)
+{
+	struct mmsghdr mmsg[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	struct address *addr;
+	int cnt, fd, i;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	if (n > TRANSPORT_BATCH_MAX)
+		n = TRANSPORT_BATCH_MAX;
+
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+
+	for (i = 0; i < n; i++) {
+		addr = &msg[i]->address;
+		addr->sin.sin_port = htons(event ? EVENT_PORT : GENERAL_PORT);
+
+		iov[i].iov_base = msg[i];
+		iov[i].iov_len = ntohs(msg[i]->header.messageLength);
+		/* See udp_send() about the two extra bytes. */
+		if (event == TRANS_ONESTEP)
+			iov[i].iov_len += 2;
+
+		mmsg[i].msg_hdr.msg_name = &addr->sa;
+		mmsg[i].msg_hdr.msg_namelen = sizeof(addr->sin);
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	cnt = sendmmsg(fd, mmsg, n, 0);
+	if (cnt < 1) {
+		pr_err("sendmmsg failed: %m");
+		return -errno;
+	}
+	return cnt;
+}
+
 static void udp_release(struct transport *t)
 {
 	struct udp *udp = container_of(t, struct udp, t);
@@ -319,7 +379,9 @@ struct transport *udp_transport_create(void)
 	udp->t.open  = udp_open;
 	udp->t.update_rx_filter = udp_update_rx_filter;
 	udp->t.recv  = udp_recv;
+	udp->t.recvmany = udp_recvmany;
 	udp->t.send  = udp_send;
+	udp->t.sendmany = udp_sendmany;
 	udp->t.release = udp_release;
 	udp->t.physical_addr = udp_physical_addr;
 	udp->t.protocol_addr = udp_protocol_addr;
@@ -246,6 +246,26 @@ static int udp6_recv(struct transport *t, int fd, void *buf, int buflen,
 	return sk_receive(fd, buf, buflen, addr, hwts, MSG_DONTWAIT);
 }
 
+static int udp6_recvmany(struct transport *t, int fd, struct ptp_message **msg,
+			 int *cnt, int n)
+{
+	struct hw_timestamp *hwts[TRANSPORT_BATCH_MAX];
+	struct address *addr[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	int i;
+
+	if (n > TRANSPORT_BATCH_MAX)
+		n = TRANSPORT_BATCH_MAX;
+
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = msg[i];
+		iov[i].iov_len = sizeof(msg[i]->data);
+		addr[i] = &msg[i]->address;
+		hwts[i] = &msg[i]->hwts;
+	}
+	return sk_receive_many(fd, iov, addr, hwts, cnt, n);
+}
+
 static int udp6_send(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, int peer, void *buf, int len,
 		     struct address *addr, struct hw_timestamp *hwts)
@@ -295,6 +315,44 @@ static int udp6_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int udp6_sendmany(struct transport *t, struct fdarray *fda,
+			 enum transport_event event, struct ptp_message **msg,
+			 int n)
+{
+	struct mmsghdr mmsg[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	struct address *addr;
+	int cnt, fd, i;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	if (n > TRANSPORT_BATCH_MAX)
+		n = TRANSPORT_BATCH_MAX;
+
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+
+	for (i = 0; i < n; i++) {
+		addr = &msg[i]->address;
+		addr->sin6.sin6_port = htons(event ? EVENT_PORT : GENERAL_PORT);
+
+		iov[i].iov_base = msg[i];
+		/* Extend the payload by two, for UDP checksum corrections. */
+		iov[i].iov_len = ntohs(msg[i]->header.messageLength) + 2;
+
+		mmsg[i].msg_hdr.msg_name = &addr->sa;
+		mmsg[i].msg_hdr.msg_namelen = sizeof(addr->sin6);
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	cnt = sendmmsg(fd, mmsg, n, 0);
+	if (cnt < 1) {
+		pr_err("sendmmsg failed: %m");
+		return -errno;
+	}
+	return cnt;
+}
+
 static void udp6_release(struct transport *t)
 {
 	struct udp6 *udp6 = container_of(t, struct udp6, t);
@@ -335,7 +393,9 @@ struct transport *udp6_transport_create(void)
 	udp6->t.open    = udp6_open;
 	udp6->t.update_rx_filter = udp6_update_rx_filter;
 	udp6->t.recv    = udp6_recv;
+	udp6->t.recvmany = udp6_recvmany;
 	udp6->t.send    = udp6_send;
+	udp6->t.sendmany = udp6_sendmany;
 	udp6->t.release = udp6_release;
 	udp6->t.physical_addr = udp6_physical_addr;
 	udp6->t.protocol_addr = udp6_protocol_addr;
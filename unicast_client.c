@@ -82,6 +82,21 @@ static int attach_cancel(struct ptp_message *msg, uint8_t message_type)
 	return 0;
 }
 
+/*
+ * While the servo acquires lock, the Sync and Delay_Resp messages are
+ * requested at the fast acquisition rates.
+ */
+static Integer8 unicast_client_sync_interval(struct port *p)
+{
+	return p->fast_acquiring ? p->fastLogSyncInterval : p->logSyncInterval;
+}
+
+static Integer8 unicast_client_delay_interval(struct port *p)
+{
+	return p->fast_acquiring ? p->fastLogMinDelayReqInterval :
+		p->initialLogMinDelayReqInterval;
+}
+
 static int unicast_client_announce(struct port *p,
 				   struct unicast_master_address *dst)
 {
@@ -196,14 +211,15 @@ static int unicast_client_renew(struct port *p,
 	}
 
 	if (dst->state == UC_HAVE_SYDY) {
-		err = attach_request(msg, p->logSyncInterval, SYNC,
-				     p->unicast_req_duration);
+		err = attach_request(msg, unicast_client_sync_interval(p),
+				     SYNC, p->unicast_req_duration);
 		if (err) {
 			goto out;
 		}
 		if (p->delayMechanism != DM_P2P &&
 				p->delayMechanism != DM_NO_MECHANISM) {
-			err = attach_request(msg, p->logMinDelayReqInterval,
+			err = attach_request(msg,
+					     unicast_client_delay_interval(p),
 					     DELAY_RESP,
 					     p->unicast_req_duration);
 			if (err) {
@@ -250,15 +266,15 @@ static int unicast_client_sydy(struct port *p,
 	if (!msg) {
 		return -1;
 	}
-	err = attach_request(msg, p->logSyncInterval, SYNC,
+	err = attach_request(msg, unicast_client_sync_interval(p), SYNC,
 			     p->unicast_req_duration);
 	if (err) {
 		goto out;
 	}
 	if (p->delayMechanism != DM_P2P &&
 			p->delayMechanism != DM_NO_MECHANISM) {
-		err = attach_request(msg, p->logMinDelayReqInterval, DELAY_RESP,
-				p->unicast_req_duration);
+		err = attach_request(msg, unicast_client_delay_interval(p),
+				     DELAY_RESP, p->unicast_req_duration);
 		if (err) {
 			goto out;
 		}
@@ -515,9 +531,16 @@ void unicast_client_grant(struct port *p, struct ptp_message *m,
 	case UC_HAVE_SYDY:
 		switch (mtype) {
 		case ANNOUNCE:
+			unicast_client_set_renewal(p, ucma, g->durationField);
+			break;
 		case DELAY_RESP:
+			unicast_client_set_renewal(p, ucma, g->durationField);
+			p->logMinDelayReqInterval = g->logInterMessagePeriod;
+			break;
 		case SYNC:
 			unicast_client_set_renewal(p, ucma, g->durationField);
+			/* The interval changes on a renewal at a new rate. */
+			clock_sync_interval(p->clock, g->logInterMessagePeriod);
 			break;
 		}
 		break;
@@ -556,6 +579,23 @@ void unicast_client_state_changed(struct port *p)
 	}
 }
 
+void unicast_client_rate_changed(struct port *p)
+{
+	struct unicast_master_address *master;
+
+	if (!unicast_client_enabled(p)) {
+		return;
+	}
+	STAILQ_FOREACH(master, &p->unicast_master_table->addrs, list) {
+		if (master->type != transport_type(p->trp) ||
+		    master->state != UC_HAVE_SYDY) {
+			continue;
+		}
+		master->renewal_tmo = 0;
+		unicast_client_renew(p, master);
+	}
+}
+
 int unicast_client_timer(struct port *p)
 {
 	struct unicast_master_address *master;
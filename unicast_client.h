@@ -78,6 +78,13 @@ int unicast_client_set_tmo(struct port *p);
  */
 void unicast_client_state_changed(struct port *p);
 
+/**
+ * Renews the Sync and Delay_Resp grants at once, for example when the
+ * requested message rates have changed.
+ * @param p      The port in question.
+ */
+void unicast_client_rate_changed(struct port *p);
+
 /**
  * Handles the unicast request timer, sending requests as needed.
  * @param p      The port in question.
@@ -32,9 +32,12 @@
 #include "util.h"
 
 #define QUEUE_LEN 16
+#define CLIENT_TABLE_SIZE 256
 
 struct unicast_client_address {
 	LIST_ENTRY(unicast_client_address) list;
+	LIST_ENTRY(unicast_client_address) hash;
+	struct unicast_service_interval *interval;
 	struct PortIdentity portIdentity;
 	struct {
 		UInteger16 announce;
@@ -43,6 +46,8 @@ struct unicast_client_address {
 	unsigned int message_types;
 	struct address addr;
 	time_t grant_tmo;
+	/* Value of grant_tmo when entered into the expiry queue. */
+	time_t queued_tmo;
 };
 
 struct unicast_service_interval {
@@ -55,7 +60,11 @@ struct unicast_service_interval {
 
 struct unicast_service {
 	LIST_HEAD(usi, unicast_service_interval) intervals;
+	/* All client records, hashed by address. */
+	LIST_HEAD(uch, unicast_client_address) table[CLIENT_TABLE_SIZE];
 	struct pqueue *queue;
+	/* All client records, ordered by grant expiry. Owns the memory. */
+	struct pqueue *expiry;
 };
 
 static struct timespec log_to_timespec(int log_seconds);
@@ -108,6 +117,66 @@ static int attach_interface_rate(struct ptp_message *msg,
 	return 0;
 }
 
+/*
+ * Hashes the part of the address that addreq() compares, so that
+ * equal addresses always land in the same bucket.
+ */
+static unsigned int client_hash(enum transport_type type, struct address *a)
+{
+	unsigned int i, h, len;
+	unsigned char *buf;
+
+	switch (type) {
+	case TRANS_UDP_IPV4:
+		buf = (unsigned char *) &a->sin.sin_addr;
+		len = sizeof(a->sin.sin_addr);
+		break;
+	case TRANS_UDP_IPV6:
+		buf = (unsigned char *) &a->sin6.sin6_addr;
+		len = sizeof(a->sin6.sin6_addr);
+		break;
+	case TRANS_IEEE_802_3:
+		buf = (unsigned char *) &a->sll.sll_addr;
+		len = MAC_LEN;
+		break;
+	default:
+		return 0;
+	}
+	for (h = 0, i = 0; i < len; i++) {
+		h = 131 * h + buf[i];
+	}
+	return h % CLIENT_TABLE_SIZE;
+}
+
+/*
+ * Removes a client from service. The record itself stays in the expiry
+ * queue until its grant runs out, as the queue cannot drop arbitrary
+ * entries.
+ */
+static void client_unlink(struct unicast_client_address *client)
+{
+	LIST_REMOVE(client, list);
+	LIST_REMOVE(client, hash);
+	client->interval = NULL;
+	client->message_types = 0;
+}
+
+static int compare_grant(void *ain, void *bin)
+{
+	struct unicast_client_address *a, *b;
+
+	a = (struct unicast_client_address *) ain;
+	b = (struct unicast_client_address *) bin;
+
+	if (a->queued_tmo < b->queued_tmo) {
+		return 1;
+	}
+	if (b->queued_tmo < a->queued_tmo) {
+		return -1;
+	}
+	return 0;
+}
+
 static int compare_timeout(void *ain, void *bin)
 {
 	struct unicast_service_interval *a, *b;
@@ -185,43 +254,115 @@ static void timespec_normalize(struct timespec *ts)
 	}
 }
 
+/*
+ * Consecutive messages of one type that are waiting to be sent in a
+ * single batch. A message of the other type ends the batch, so that the
+ * messages go out in the order of the clients.
+ */
+struct unicast_service_batch {
+	int type;
+	struct address *dst[TRANSPORT_BATCH_MAX];
+	uint16_t seqnum[TRANSPORT_BATCH_MAX];
+	int count;
+};
+
+static int unicast_service_flush(struct port *p,
+				 struct unicast_service_batch *batch)
+{
+	int err = 0;
+
+	if (!batch->count) {
+		return 0;
+	}
+	switch (batch->type) {
+	case ANNOUNCE:
+		err = port_tx_announce_batch(p, batch->dst, batch->seqnum,
+					     batch->count);
+		break;
+	case SYNC:
+		err = port_tx_sync_batch(p, batch->dst, batch->seqnum,
+					 batch->count);
+		break;
+	}
+	batch->count = 0;
+	return err;
+}
+
+static int unicast_service_batch_add(struct port *p,
+				     struct unicast_service_batch *batch,
+				     int type, struct address *dst,
+				     uint16_t seqnum)
+{
+	int err = 0;
+
+	if (batch->count &&
+	    (batch->type != type || batch->count == TRANSPORT_BATCH_MAX)) {
+		err = unicast_service_flush(p, batch);
+	}
+	batch->type = type;
+	batch->dst[batch->count] = dst;
+	batch->seqnum[batch->count] = seqnum;
+	batch->count++;
+	return err;
+}
+
 static int unicast_service_clients(struct port *p,
 				   struct unicast_service_interval *interval)
 {
-	struct unicast_client_address *client, *next;
-	struct timespec now;
+	struct unicast_service_batch batch = { .count = 0 };
+	struct unicast_client_address *client;
 	int err = 0;
 
-	err = clock_gettime(CLOCK_MONOTONIC, &now);
-	if (err) {
-		pr_err("clock_gettime failed: %m");
-		return err;
-	}
-	LIST_FOREACH_SAFE(client, &interval->clients, list, next) {
+	LIST_FOREACH(client, &interval->clients, list) {
 		pr_debug("%s wants 0x%x", pid2str(&client->portIdentity),
 			 client->message_types);
-		if (now.tv_sec > client->grant_tmo) {
+		if (client->message_types & (1 << ANNOUNCE) &&
+		    unicast_service_batch_add(p, &batch, ANNOUNCE,
+					      &client->addr,
+					      client->seqnum.announce++)) {
+			err = -1;
+		}
+		if (client->message_types & (1 << SYNC) &&
+		    unicast_service_batch_add(p, &batch, SYNC,
+					      &client->addr,
+					      client->seqnum.sync++)) {
+			err = -1;
+		}
+	}
+	if (unicast_service_flush(p, &batch)) {
+		err = -1;
+	}
+	return err;
+}
+
+/*
+ * Drops the clients whose grants have run out. A grant that was
+ * extended after its record was queued is simply queued again.
+ */
+static void unicast_service_expire(struct port *p, struct timespec *now)
+{
+	struct unicast_client_address *client;
+
+	while ((client = pqueue_peek(p->unicast_service->expiry)) != NULL) {
+		if (now->tv_sec <= client->queued_tmo) {
+			break;
+		}
+		client = pqueue_extract(p->unicast_service->expiry);
+
+		if (client->interval && now->tv_sec <= client->grant_tmo) {
+			client->queued_tmo = client->grant_tmo;
+			/* Cannot fail, as the queue has just shrunk. */
+			pqueue_insert(p->unicast_service->expiry, client);
+			continue;
+		}
+		if (client->interval) {
 			pr_debug("%s service of 0x%x expired",
 				 pid2str(&client->portIdentity),
 				 client->message_types);
-			LIST_REMOVE(client, list);
-			free(client);
-			continue;
-		}
-		if (client->message_types & (1 << ANNOUNCE)) {
-			if (port_tx_announce(p, &client->addr,
-					     client->seqnum.announce++)) {
-				err = -1;
-			}
-		}
-		if (client->message_types & (1 << SYNC)) {
-			if (port_tx_sync(p, &client->addr,
-					 client->seqnum.sync++)) {
-				err = -1;
-			}
+			client_unlink(client);
 		}
+		free(client);
 	}
-	return err;
 }
 
 static void unicast_service_extend(struct unicast_client_address *client,
@@ -305,7 +446,7 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 	struct unicast_client_address *client = NULL, *ctmp, *next;
 	struct unicast_service_interval *interval = NULL, *itmp;
 	struct request_unicast_xmit_tlv *req;
-	unsigned int mask;
+	unsigned int h, mask;
 	uint8_t mtype;
 
 	if (!p->unicast_service) {
@@ -331,37 +472,38 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 		return SERVICE_DENIED;
 	}
 
+	/*
+	 * Remember the interval of interest.
+	 */
 	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		/*
-		 * Remember the interval of interest.
-		 */
 		if (itmp->log_period == req->logInterMessagePeriod) {
 			interval = itmp;
+			break;
 		}
-		/*
-		 * Find any client records, and remove any stale contract.
-		 */
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (interval == itmp) {
-				if (ctmp->message_types & mask) {
-					/* Contract is unchanged. */
-					unicast_service_extend(ctmp, req);
-					return SERVICE_GRANTED;
-				}
-				/* This is the one to use. */
-				client = ctmp;
-				continue;
-			}
-			/* Clear any stale contracts. */
-			ctmp->message_types &= ~mask;
-			if (!ctmp->message_types) {
-				LIST_REMOVE(ctmp, list);
-				free(ctmp);
+	}
+	/*
+	 * Find any client records, and remove any stale contract.
+	 */
+	h = client_hash(transport_type(p->trp), &m->address);
+
+	LIST_FOREACH_SAFE(ctmp, &p->unicast_service->table[h], hash, next) {
+		if (!addreq(transport_type(p->trp), &ctmp->addr, &m->address)) {
+			continue;
+		}
+		if (ctmp->interval == interval) {
+			if (ctmp->message_types & mask) {
+				/* Contract is unchanged. */
+				unicast_service_extend(ctmp, req);
+				return SERVICE_GRANTED;
 			}
+			/* This is the one to use. */
+			client = ctmp;
+			continue;
+		}
+		/* Clear any stale contracts. */
+		ctmp->message_types &= ~mask;
+		if (!ctmp->message_types) {
+			client_unlink(ctmp);
 		}
 	}
 
@@ -396,26 +538,34 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 		}
 		unicast_service_rearm_timer(p);
 	}
+	client->queued_tmo = client->grant_tmo;
+	if (pqueue_insert(p->unicast_service->expiry, client)) {
+		/* An empty interval retires on its own. */
+		free(client);
+		return SERVICE_DENIED;
+	}
+	client->interval = interval;
 	LIST_INSERT_HEAD(&interval->clients, client, list);
+	LIST_INSERT_HEAD(&p->unicast_service->table[h], client, hash);
 	return SERVICE_GRANTED;
 }
 
 void unicast_service_cleanup(struct port *p)
 {
 	struct unicast_service_interval *itmp, *inext;
-	struct unicast_client_address *ctmp, *cnext;
+	struct unicast_client_address *ctmp;
 
 	if (!p->unicast_service) {
 		return;
 	}
 	LIST_FOREACH_SAFE(itmp, &p->unicast_service->intervals, list, inext) {
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, cnext) {
-			LIST_REMOVE(ctmp, list);
-			free(ctmp);
-		}
 		LIST_REMOVE(itmp, list);
 		free(itmp);
 	}
+	while ((ctmp = pqueue_extract(p->unicast_service->expiry)) != NULL) {
+		free(ctmp);
+	}
+	pqueue_destroy(p->unicast_service->expiry);
 	pqueue_destroy(p->unicast_service->queue);
 	free(p->unicast_service);
 }
@@ -441,6 +591,7 @@ int unicast_service_grant(struct port *p, struct ptp_message *m,
 int unicast_service_initialize(struct port *p)
 {
 	struct config *cfg = clock_config(p->clock);
+	int i;
 
 	if (!config_get_int(cfg, p->name, "unicast_listen")) {
 		return 0;
@@ -453,12 +604,21 @@ int unicast_service_initialize(struct port *p)
 		return -1;
 	}
 	LIST_INIT(&p->unicast_service->intervals);
+	for (i = 0; i < CLIENT_TABLE_SIZE; i++) {
+		LIST_INIT(&p->unicast_service->table[i]);
+	}
 
 	p->unicast_service->queue = pqueue_create(QUEUE_LEN, compare_timeout);
 	if (!p->unicast_service->queue) {
 		free(p->unicast_service);
 		return -1;
 	}
+	p->unicast_service->expiry = pqueue_create(QUEUE_LEN, compare_grant);
+	if (!p->unicast_service->expiry) {
+		pqueue_destroy(p->unicast_service->queue);
+		free(p->unicast_service);
+		return -1;
+	}
 	p->inhibit_multicast_service =
 		config_get_int(cfg, p->name, "inhibit_multicast_service");
 
@@ -468,10 +628,9 @@ int unicast_service_initialize(struct port *p)
 void unicast_service_remove(struct port *p, struct ptp_message *m,
 			    struct tlv_extra *extra)
 {
-	struct unicast_client_address *ctmp, *next;
+	struct unicast_client_address *ctmp;
 	struct cancel_unicast_xmit_tlv *cancel;
-	struct unicast_service_interval *itmp;
-	unsigned int mask;
+	unsigned int h, mask;
 	uint8_t mtype;
 
 	if (!p->unicast_service) {
@@ -494,20 +653,18 @@ void unicast_service_remove(struct port *p, struct ptp_message *m,
 		return;
 	}
 
-	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (ctmp->message_types & mask) {
-				ctmp->message_types &= ~mask;
-				if (!ctmp->message_types) {
-					LIST_REMOVE(ctmp, list);
-					free(ctmp);
-				}
-				return;
+	h = client_hash(transport_type(p->trp), &m->address);
+
+	LIST_FOREACH(ctmp, &p->unicast_service->table[h], hash) {
+		if (!addreq(transport_type(p->trp), &ctmp->addr, &m->address)) {
+			continue;
+		}
+		if (ctmp->message_types & mask) {
+			ctmp->message_types &= ~mask;
+			if (!ctmp->message_types) {
+				client_unlink(ctmp);
 			}
+			return;
 		}
 	}
 }
@@ -523,6 +680,8 @@ int unicast_service_timer(struct port *p)
 	}
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
+	unicast_service_expire(p, &now);
+
 	switch (p->state) {
 	case PS_INITIALIZING:
 	case PS_FAULTY: